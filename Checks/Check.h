@@ -0,0 +1,21 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+namespace {
+	int failures = 0;
+
+	void check(bool condition, const std::string& what) {
+		if (!condition) {
+			std::cerr << "Failed: " << what << std::endl;
+			++failures;
+		}
+	}
+
+	std::string bytes(std::initializer_list<int> values) {
+		std::string data;
+		for (int value : values) data += (char)value;
+		return data;
+	}
+}
@@ -0,0 +1,49 @@
+#include "Check.h"
+#include "../Sources/D3DContainer.h"
+
+using namespace krafix;
+
+int main() {
+	D3DContainer container;
+	container.attributes["pos"] = 0;
+	container.attributes["tex"] = 1;
+	D3DResource sampler;
+	sampler.name = "_image_sampler";
+	sampler.bindPoint = 2;
+	container.resources.push_back(sampler);
+	D3DResource globals;
+	globals.name = "$Globals";
+	container.resources.push_back(globals);
+	D3DConstant matrix;
+	matrix.name = "mvp";
+	matrix.offset = 16;
+	matrix.size = 64;
+	matrix.columns = 4;
+	matrix.rows = 4;
+	container.constants.push_back(matrix);
+	D3D9Constant constant;
+	constant.name = "mvp";
+	constant.registerIndex = 1;
+	constant.registerCount = 4;
+	container.registers.push_back(constant);
+
+	std::string attributes = bytes({ 2, 'p', 'o', 's', 0, 0, 't', 'e', 'x', 0, 1 });
+
+	std::vector<char> bytecode = { 'D', 'X', 'B', 'C' };
+	std::string d3d11 = writeD3D11Container(container, bytecode);
+	std::string expected11 = attributes
+		+ bytes({ 2, '_', 'i', 'm', 'a', 'g', 'e', '_', 's', 'a', 'm', 'p', 'l', 'e', 'r', 0, 2, '$', 'G', 'l', 'o', 'b', 'a', 'l', 's', 0, 0 })
+		+ bytes({ 1, 'm', 'v', 'p', 0, 16, 0, 0, 0, 64, 0, 0, 0, 4, 4 })
+		+ "DXBC";
+	check(d3d11 == expected11, "D3D11 container layout");
+
+	// Version token, a comment token of two words, one instruction token and the end token
+	std::vector<char> d3d9Bytecode = { 0, 3, (char)0xfe, (char)0xff, (char)0xfe, (char)0xff, 2, 0, 1, 2, 3, 4, 5, 6, 7, 8, 1, 0, 0, 0, (char)0xff, (char)0xff, 0, 0 };
+	std::string d3d9 = writeD3D9Container(container, d3d9Bytecode);
+	std::string expected9 = attributes
+		+ bytes({ 1, 'm', 'v', 'p', 0, 'f', 1, 4 })
+		+ bytes({ 0, 3, 0xfe, 0xff, 1, 0, 0, 0, 0xff, 0xff, 0, 0 });
+	check(d3d9 == expected9, "D3D9 container layout without comment tokens");
+
+	return failures == 0 ? 0 : 1;
+}
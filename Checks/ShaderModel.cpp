@@ -0,0 +1,104 @@
+#include "Check.h"
+#include "ShaderModel.h"
+#include "SpirVModule.h"
+
+#include <SPIRV/spirv.hpp>
+
+using namespace krafix;
+using namespace spv;
+
+namespace {
+	enum Ids {
+		VoidType = 1, FunctionType, FloatType, Vec4Type, InputPointer, ImageType, SampledImageType, ImagePointer, Vec2Type, Texture,
+		Main, Label, Color, TexCoord, Inputs = 100, Values = 200
+	};
+
+	// Vertex or fragment module with the given number of vec4 inputs that adds them up additions times
+	struct Module {
+		std::vector<uint32_t> capabilities;
+		unsigned inputs = 1;
+		unsigned additions = 0;
+		bool derivative = false;
+		bool textureSample = false;
+
+		std::vector<uint32_t> assemble() const {
+			std::vector<uint32_t> words = { MagicNumber, 0x10000, 0, 1000, 0 };
+			auto add = [&](uint32_t op, const std::vector<uint32_t>& operands) {
+				std::vector<uint32_t> instruction = SpirVModule::makeInstruction(op, operands);
+				words.insert(words.end(), instruction.begin(), instruction.end());
+			};
+			add(OpCapability, { CapabilityShader });
+			for (uint32_t capability : capabilities) add(OpCapability, { capability });
+			add(OpMemoryModel, { AddressingModelLogical, MemoryModelGLSL450 });
+			add(OpTypeVoid, { VoidType });
+			add(OpTypeFunction, { FunctionType, VoidType });
+			add(OpTypeFloat, { FloatType, 32 });
+			add(OpTypeVector, { Vec4Type, FloatType, 4 });
+			add(OpTypeVector, { Vec2Type, FloatType, 2 });
+			add(OpTypePointer, { InputPointer, StorageClassInput, Vec4Type });
+			add(OpTypeImage, { ImageType, FloatType, Dim2D, 0, 0, 0, 1, ImageFormatUnknown });
+			add(OpTypeSampledImage, { SampledImageType, ImageType });
+			add(OpTypePointer, { ImagePointer, StorageClassUniformConstant, SampledImageType });
+			add(OpVariable, { ImagePointer, Texture, StorageClassUniformConstant });
+			for (uint32_t i = 0; i < inputs; ++i) add(OpVariable, { InputPointer, Inputs + i, StorageClassInput });
+			add(OpFunction, { VoidType, Main, 0, FunctionType });
+			add(OpLabel, { Label });
+			add(OpLoad, { Vec4Type, Color, Inputs });
+			uint32_t value = Color;
+			for (uint32_t i = 0; i < additions; ++i) {
+				add(OpFAdd, { Vec4Type, Values + i, value, Color });
+				value = Values + i;
+			}
+			if (derivative) add(OpDPdx, { Vec4Type, Values + additions, value });
+			if (textureSample) {
+				add(OpVectorShuffle, { Vec2Type, TexCoord, Color, Color, 0, 1 });
+				add(OpLoad, { SampledImageType, Values + additions + 1, Texture });
+				add(OpImageSampleImplicitLod, { Vec4Type, Values + additions + 2, Values + additions + 1, TexCoord });
+			}
+			add(OpReturn, {});
+			add(OpFunctionEnd, {});
+			return words;
+		}
+	};
+}
+
+int main() {
+	Module simple;
+	check(inferShaderModel(simple.assemble(), StageFragment, true) == 20, "A plain fragment shader fits ps_2_0");
+	check(inferShaderModel(simple.assemble(), StageFragment, false) == 40, "A plain fragment shader fits ps_4_0");
+	check(inferShaderModel(simple.assemble(), StageTessControl, false) == 50, "Tessellation needs shader model 5");
+
+	Module derivative;
+	derivative.derivative = true;
+	check(inferShaderModel(derivative.assemble(), StageFragment, true) == 30, "ps_2_0 has no derivatives");
+	check(inferShaderModel(derivative.assemble(), StageFragment, false) == 40, "ps_4_0 has derivatives");
+
+	Module vertexTexture;
+	vertexTexture.textureSample = true;
+	check(inferShaderModel(vertexTexture.assemble(), StageFragment, true) == 20, "ps_2_0 samples textures");
+	check(inferShaderModel(vertexTexture.assemble(), StageVertex, true) == 30, "vs_2_0 has no texture fetch");
+
+	Module longShader;
+	longShader.additions = 64;
+	check(inferShaderModel(longShader.assemble(), StageFragment, true) == 20, "64 additions fit the ps_2_0 arithmetic slots");
+	longShader.additions = 65;
+	check(inferShaderModel(longShader.assemble(), StageFragment, true) == 30, "65 additions exceed the ps_2_0 arithmetic slots");
+
+	Module interpolators;
+	interpolators.inputs = 9;
+	check(inferShaderModel(interpolators.assemble(), StageFragment, true) == 30, "ps_2_0 has 8 texture coordinates");
+	check(inferShaderModel(interpolators.assemble(), StageFragment, false) == 40, "ps_4_0 has 16 interpolators");
+	interpolators.inputs = 17;
+	check(inferShaderModel(interpolators.assemble(), StageFragment, false) == 50, "17 interpolators need shader model 5");
+
+	Module cubeArray;
+	cubeArray.capabilities.push_back(CapabilitySampledCubeArray);
+	check(inferShaderModel(cubeArray.assemble(), StageFragment, false) == 50, "Cube map arrays need shader model 5");
+
+	check(shaderProfile(StageFragment, 20) == "ps_2_0", "Pixel shader 2.0 profile");
+	check(shaderProfile(StageVertex, 40) == "vs_4_0", "Vertex shader 4.0 profile");
+	check(shaderProfile(StageTessControl, 40) == "", "No hull shader profile before 5.0");
+	check(shaderProfile(StageCompute, 50) == "cs_5_0", "Compute shader 5.0 profile");
+
+	return failures == 0 ? 0 : 1;
+}
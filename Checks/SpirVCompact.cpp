@@ -0,0 +1,91 @@
+#include "Check.h"
+#include "SpirVCompact.h"
+#include "SpirVCompactWriter.h"
+#include "SpirVModule.h"
+
+#include <SPIRV/spirv.hpp>
+
+#include <fstream>
+#include <iterator>
+
+using namespace krafix;
+using namespace spv;
+
+namespace {
+	bool roundTrips(const std::vector<uint32_t>& spirv) {
+		std::vector<uint8_t> compact;
+		compactSpirv(spirv, compact);
+		size_t size = krafix_spirv_compact_decoded_size(compact.data(), compact.size());
+		if (size != spirv.size() * 4) return false;
+		std::vector<uint32_t> decoded(size / 4);
+		if (!krafix_spirv_compact_decode(compact.data(), compact.size(), decoded.data(), decoded.size())) return false;
+		return decoded == spirv;
+	}
+
+	std::vector<uint32_t> readWords(const char* filename) {
+		std::ifstream in(filename, std::ios_base::binary);
+		std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		std::vector<uint32_t> words(bytes.size() / 4);
+		for (size_t i = 0; i < words.size(); ++i) {
+			words[i] = (uint8_t)bytes[i * 4] | ((uint8_t)bytes[i * 4 + 1] << 8) | ((uint8_t)bytes[i * 4 + 2] << 16) | ((uint32_t)(uint8_t)bytes[i * 4 + 3] << 24);
+		}
+		return words;
+	}
+
+	std::vector<uint32_t> module(const std::vector<std::vector<uint32_t>>& instructions) {
+		std::vector<uint32_t> words = { MagicNumber, 0x10000, 0, 1000, 0 };
+		for (auto& instruction : instructions) words.insert(words.end(), instruction.begin(), instruction.end());
+		return words;
+	}
+}
+
+// Without arguments checks handwritten modules, with pairs of a plain and a compact krafix output
+// checks that the compact one decodes to the words of the plain one
+int main(int argc, char** argv) {
+	if (argc > 1) {
+		for (int i = 1; i + 1 < argc; i += 2) {
+			std::vector<uint32_t> plain = readWords(argv[i]);
+			std::ifstream in(argv[i + 1], std::ios_base::binary);
+			std::vector<uint8_t> compact((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+			std::vector<uint32_t> decoded(krafix_spirv_compact_decoded_size(compact.data(), compact.size()) / 4);
+			bool decodes = !decoded.empty() && krafix_spirv_compact_decode(compact.data(), compact.size(), decoded.data(), decoded.size());
+			check(decodes && decoded == plain, std::string(argv[i + 1]) + " decodes to " + argv[i]);
+			check(roundTrips(plain), std::string(argv[i]) + " round trips");
+		}
+		return failures == 0 ? 0 : 1;
+	}
+
+	std::vector<uint32_t> name = { 10 };
+	SpirVModule::appendString(name, "a name that is long enough for more than fifteen words in one instruction");
+	std::vector<uint32_t> structMembers = { 30 };
+	for (uint32_t i = 0; i < 20; ++i) structMembers.push_back(i % 2 == 0 ? 2 : 3);
+
+	check(roundTrips(module({})), "Header only");
+	check(roundTrips(module({
+		SpirVModule::makeInstruction(OpCapability, { CapabilityShader }),
+		SpirVModule::makeInstruction(OpName, name),
+		SpirVModule::makeInstruction(OpDecorate, { 10, DecorationLocation, 0 }),
+		SpirVModule::makeInstruction(OpTypeFloat, { 2, 32 }),
+		SpirVModule::makeInstruction(OpTypeVector, { 3, 2, 4 }),
+		SpirVModule::makeInstruction(OpTypeStruct, structMembers),
+		SpirVModule::makeInstruction(OpConstant, { 2, 900, 0xffffffff }),
+		// Result ids going backwards and id operands far from the result
+		SpirVModule::makeInstruction(OpFAdd, { 2, 5, 900, 2 }),
+		SpirVModule::makeInstruction(OpFMul, { 2, 999, 5, 900 }),
+		SpirVModule::makeInstruction(OpStore, { 999, 5 }),
+		SpirVModule::makeInstruction(OpStore, { 4, 998 }),
+		SpirVModule::makeInstruction(OpVectorShuffle, { 3, 40, 3, 3, 0, 1, 2, 0xffffffff }),
+		// Unknown instructions are written as plain words
+		SpirVModule::makeInstruction(0xfff0, { 0x80000000, 1, 0 })
+	})), "Types, long instructions, backward ids and unknown opcodes");
+
+	std::vector<uint8_t> compact;
+	compactSpirv(module({ SpirVModule::makeInstruction(OpCapability, { CapabilityShader }) }), compact);
+	std::vector<uint32_t> decoded(8);
+	check(krafix_spirv_compact_decode(compact.data(), compact.size() - 1, decoded.data(), decoded.size()) == 0, "Truncated data fails");
+	check(krafix_spirv_compact_decode(compact.data(), compact.size(), decoded.data(), 6) == 0, "Too small buffers fail");
+	compact[0] = 'X';
+	check(krafix_spirv_compact_decoded_size(compact.data(), compact.size()) == 0, "Wrong magic fails");
+
+	return failures == 0 ? 0 : 1;
+}
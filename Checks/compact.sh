@@ -0,0 +1,30 @@
+#!/bin/sh
+# Compiles the shaders of the tests submodule to plain and to compact SPIR-V and checks that every
+# compact module decodes to the words of the plain one and that the plain one round trips.
+# Usage: Checks/compact.sh path/to/krafix path/to/SpirVCompact (built by Checks/run.sh)
+set -e
+krafix=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+checker=$(cd "$(dirname "$2")" && pwd)/$(basename "$2")
+cd "$(dirname "$0")/.."
+build=${TMPDIR:-/tmp}/krafix-checks/compact
+shaders=$(find tests -name '*.glsl' | sort)
+if [ -z "$shaders" ]; then
+	echo "No shaders in tests, run git submodule update --init tests"
+	exit 1
+fi
+
+rm -rf "$build"
+mkdir -p "$build/temp"
+pairs=""
+for shader in $shaders; do
+	name=$(echo "$shader" | sed 's|^tests/||; s|/|_|g; s|\.glsl$||')
+	"$krafix" spirv "$shader" "$build/$name.spirv" "$build/temp" linux --quiet > /dev/null 2>&1 || continue
+	"$krafix" spirv "$shader" "$build/$name.compact.spirv" "$build/temp" linux --quiet --spirv-compact > /dev/null 2>&1 || continue
+	pairs="$pairs $build/$name.spirv $build/$name.compact.spirv"
+done
+
+if [ -z "$pairs" ]; then
+	echo "Nothing compiled"
+	exit 1
+fi
+"$checker" $pairs
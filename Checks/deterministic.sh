@@ -0,0 +1,47 @@
+#!/bin/sh
+# Compiles the shaders of the tests submodule twice with --deterministic and fails when any output byte differs.
+# The second pass runs in reverse order on several processes and compiles every shader twice in one process.
+# Usage: Checks/deterministic.sh path/to/krafix
+set -e
+script=$(cd "$(dirname "$0")" && pwd)/$(basename "$0")
+build=${TMPDIR:-/tmp}/krafix-checks/deterministic
+
+# Compiles one shader for every profile that works without the Windows shader compilers
+if [ "$1" = "--shader" ]; then
+	krafix=$2
+	out=$3
+	shader=$4
+	shift 4
+	name=$(echo "$shader" | sed 's|^tests/||; s|/|_|g; s|\.glsl$||')
+	for profile in spirv glsl essl metal varlist; do
+		system=linux
+		if [ $profile = metal ]; then system=osx; fi
+		"$krafix" $profile "$shader" "$out/$name.$profile" "$build/temp" $system --deterministic --quiet "$@" > /dev/null 2>&1 || true
+	done
+	exit 0
+fi
+
+krafix=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+cd "$(dirname "$0")/.."
+shaders=$(find tests -name '*.glsl' | sort)
+if [ -z "$shaders" ]; then
+	echo "No shaders in tests, run git submodule update --init tests"
+	exit 1
+fi
+
+rm -rf "$build"
+mkdir -p "$build/first" "$build/second" "$build/temp"
+jobs=$(getconf _NPROCESSORS_ONLN 2> /dev/null || echo 4)
+if [ "$jobs" -lt 4 ]; then jobs=4; fi
+
+for shader in $shaders; do
+	sh "$script" --shader "$krafix" "$build/first" "$shader"
+done
+# --soak 1 writes the outputs of the second compile in the same process
+echo "$shaders" | sort -r | xargs -P "$jobs" -I {} sh "$script" --shader "$krafix" "$build/second" {} --soak 1
+
+if [ -z "$(ls "$build/first")" ]; then
+	echo "Nothing compiled"
+	exit 1
+fi
+diff -r "$build/first" "$build/second"
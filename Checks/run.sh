@@ -0,0 +1,32 @@
+#!/bin/sh
+# Builds and runs the checks that work without a GPU or the Windows shader compilers.
+# Usage: Checks/run.sh [path/to/krafix]
+# With a krafix binary the driver checks run on the shaders of the tests submodule as well.
+set -e
+cd "$(dirname "$0")/.."
+
+build=${TMPDIR:-/tmp}/krafix-checks
+mkdir -p "$build"
+CXX=${CXX:-c++}
+INCLUDES="-ISources -Iglslang -ISPIRV-Headers/include"
+
+unit() {
+	name=$1
+	shift
+	echo "Checking $name"
+	$CXX -std=c++11 $INCLUDES -o "$build/$name" "Checks/$name.cpp" "$@"
+	"$build/$name"
+}
+
+unit D3DContainer Sources/D3DContainer.cpp Sources/Serialization.cpp
+unit ShaderModel Sources/ShaderModel.cpp Sources/ShaderCost.cpp Sources/SpirVModule.cpp Sources/Serialization.cpp
+unit SpirVCompact Sources/SpirVCompactWriter.cpp Sources/SpirVModule.cpp
+
+if [ -n "$1" ]; then
+	echo "Checking deterministic output"
+	sh Checks/deterministic.sh "$1"
+	echo "Checking resident memory"
+	sh Checks/soak.sh "$1"
+	echo "Checking compact SPIR-V"
+	sh Checks/compact.sh "$1" "$build/SpirVCompact"
+fi
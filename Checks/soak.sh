@@ -0,0 +1,43 @@
+#!/bin/sh
+# Compiles the shaders of the tests submodule with --soak, at least 10000 compiles in total, and fails when
+# krafix reports resident memory that keeps growing. Every shader uses another profile in turn.
+# Usage: Checks/soak.sh path/to/krafix [compiles]
+set -e
+krafix=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+compiles=${2:-10000}
+cd "$(dirname "$0")/.."
+build=${TMPDIR:-/tmp}/krafix-checks/soak
+shaders=$(find tests -name '*.glsl' | sort)
+if [ -z "$shaders" ]; then
+	echo "No shaders in tests, run git submodule update --init tests"
+	exit 1
+fi
+
+rm -rf "$build"
+mkdir -p "$build/temp"
+count=$(echo "$shaders" | wc -l)
+# Short runs can not tell a leak from the allocator growing its arenas
+iterations=$(( (compiles + count - 1) / count ))
+if [ $iterations -lt 1000 ]; then iterations=1000; fi
+
+set -- spirv glsl essl metal varlist
+failed=0
+soaked=0
+for shader in $shaders; do
+	profile=$1
+	shift
+	set -- "$@" $profile
+	system=linux
+	if [ $profile = metal ]; then system=osx; fi
+	name=$(echo "$shader" | sed 's|^tests/||; s|/|_|g; s|\.glsl$||')
+	report=$("$krafix" $profile "$shader" "$build/$name.$profile" "$build/temp" $system --quiet --soak $iterations 2>&1 || true)
+	if echo "$report" | grep -q "^#soak:"; then soaked=$((soaked + 1)); fi
+	if echo "$report" | grep -q "^Resident memory grew"; then
+		echo "$shader ($profile): $(echo "$report" | grep "^Resident memory grew")"
+		failed=1
+	fi
+done
+
+echo "Soaked $soaked of $count shaders with $iterations compiles each"
+if [ $soaked -eq 0 ]; then exit 1; fi
+exit $failed
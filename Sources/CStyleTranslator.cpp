@@ -13,10 +13,6 @@ void _itoa(int value, char* str, int base) {
 }
 #endif
 
-namespace {
-	int unnamedCount = 0;
-}
-
 CStyleTranslator::CStyleTranslator(std::vector<unsigned>& spirv, ShaderStage stage) : Translator(spirv, stage) {
 	for (unsigned i = 0; i < instructions.size(); ++i) {
 		Instruction& inst = instructions[i];
@@ -165,7 +165,8 @@ namespace krafix {
 		unsigned entryPoint = -1;
 		unsigned vtxIdVarId = -1;
 		unsigned instIdVarId = -1;
-		unsigned tempNameIndex;
+		unsigned tempNameIndex = 0;
+		int unnamedCount = 0;
 		std::vector<Function*> functions;
 		std::ostream* tempout = NULL;
 		
@@ -0,0 +1,24 @@
+#include "CrossIR.h"
+#include "../SPIRV-Cross/spirv_parser.hpp"
+
+using namespace krafix;
+
+std::shared_ptr<const spirv_cross::ParsedIR> CrossIRCache::parse(const std::vector<unsigned>& spirv) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto module = modules.find(spirv);
+		if (module != modules.end()) return module->second;
+	}
+
+	std::shared_ptr<const spirv_cross::ParsedIR> ir = parseCrossIR(spirv, nullptr);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	return modules.insert(std::make_pair(spirv, ir)).first->second;
+}
+
+std::shared_ptr<const spirv_cross::ParsedIR> krafix::parseCrossIR(const std::vector<unsigned>& spirv, CrossIRCache* cache) {
+	if (cache != nullptr) return cache->parse(spirv);
+	spirv_cross::Parser parser(spirv);
+	parser.parse();
+	return std::make_shared<spirv_cross::ParsedIR>(std::move(parser.get_parsed_ir()));
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace spirv_cross {
+	class ParsedIR;
+}
+
+namespace krafix {
+	// SPIRV-Cross IR of the modules the driver translates from one source file. Translators rewrite the SPIR-V for
+	// their target before parsing, so modules are told apart by their words and only equal ones, like the flavours of
+	// a stage, share a parse. Every compiler gets its own copy of the IR so translators can run on separate threads.
+	class CrossIRCache {
+	public:
+		std::shared_ptr<const spirv_cross::ParsedIR> parse(const std::vector<unsigned>& spirv);
+
+	private:
+		std::mutex mutex;
+		std::map<std::vector<unsigned>, std::shared_ptr<const spirv_cross::ParsedIR>> modules;
+	};
+
+	// Parses through the cache of the driver when there is one
+	std::shared_ptr<const spirv_cross::ParsedIR> parseCrossIR(const std::vector<unsigned>& spirv, CrossIRCache* cache);
+}
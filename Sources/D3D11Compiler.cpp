@@ -1,15 +1,15 @@
+#include "D3DContainer.h"
 #include "../glslang/glslang/Public/ShaderLang.h"
+#include <cstring>
+#include <fstream>
+#include <iostream>
 #include <map>
 #include <string>
+#include <vector>
 
 #ifdef _WIN32
-#define INITGUID
 #include <Windows.h>
-#include <d3d11.h>
 #include <D3Dcompiler.h>
-#include <fstream>
-#include <iostream>
-#include <strstream>
 #endif
 
 namespace {
@@ -50,115 +50,67 @@ namespace {
 	}
 }
 
-int compileHLSLToD3D11(const char* fromRelative, const char* to, const char* source, char* output, int* outputlength, const std::map<std::string, int>& attributes, EShLanguage stage, bool debug) {
+bool compileD3D11Bytecode(const char* fromRelative, const char* source, const char* profile, bool debug, std::vector<char>& bytecode, std::string& errors) {
 #ifdef _WIN32
 	char from[256];
-	int length;
-	char* data;
+	std::vector<char> data;
 	if (source) {
 		strcpy(from, fromRelative);
-		data = (char*)source;
-		length = strlen(source);
+		data.assign(source, source + strlen(source));
 	}
 	else {
 		GetFullPathNameA(fromRelative, 255, from, nullptr);
 
 		FILE* in = fopen(from, "rb");
 		if (!in) {
-			printf("Error: unable to open input file: %s\n", from);
-			return 1;
+			errors = std::string("Error: unable to open input file: ") + from + "\n";
+			return false;
 		}
 
 		fseek(in, 0, SEEK_END);
-		length = ftell(in);
+		long length = ftell(in);
 		rewind(in);
 
-		data = new char[length];
-		fread(data, 1, length, in);
+		data.resize(length);
+		fread(data.data(), 1, length, in);
 
 		fclose(in);
 	}
 
-	ID3DBlob* errorMessage;
-	ID3DBlob* shaderBuffer;
+	ID3DBlob* errorMessage = nullptr;
+	ID3DBlob* shaderBuffer = nullptr;
 	UINT flags = 0;
 	if (debug) flags |= D3DCOMPILE_DEBUG;
-	HRESULT hr = D3DCompile(data, length, from, nullptr, nullptr, "main", shaderString(stage, 4), flags, 0, &shaderBuffer, &errorMessage);
-	if (hr != S_OK) hr = D3DCompile(data, length, from, nullptr, nullptr, "main", shaderString(stage, 5), flags, 0, &shaderBuffer, &errorMessage);
-	if (hr == S_OK) {
-		std::ostream* file;
-		std::ofstream actualfile;
-		std::ostrstream arrayout(output, 1024 * 1024);
-		*outputlength = 0;
-
-		if (output) {
-			file = &arrayout;
-		}
-		else {
-			actualfile.open(to, std::ios_base::binary);
-			file = &actualfile;
-		}
-
-		file->put((char)attributes.size()); *outputlength += 1;
-		for (std::map<std::string, int>::const_iterator attribute = attributes.begin(); attribute != attributes.end(); ++attribute) {
-			(*file) << attribute->first.c_str(); *outputlength += attribute->first.length();
-			file->put(0); *outputlength += 1;
-			file->put(attribute->second); *outputlength += 1;
-		}
-
-		ID3D11ShaderReflection* reflector = nullptr;
-		D3DReflect(shaderBuffer->GetBufferPointer(), shaderBuffer->GetBufferSize(), IID_ID3D11ShaderReflection, (void**)&reflector);
-
-		D3D11_SHADER_DESC desc;
-		reflector->GetDesc(&desc);
+	HRESULT hr = D3DCompile(data.data(), data.size(), from, nullptr, nullptr, "main", profile, flags, 0, &shaderBuffer, &errorMessage);
+	if (hr != S_OK) {
+		if (errorMessage != nullptr) errors.assign((char*)errorMessage->GetBufferPointer(), errorMessage->GetBufferSize());
+		return false;
+	}
+	bytecode.assign((char*)shaderBuffer->GetBufferPointer(), (char*)shaderBuffer->GetBufferPointer() + shaderBuffer->GetBufferSize());
+	return true;
+#else
+	errors = "D3DCompile is only available on Windows, use --d3d-bytecode-command to compile elsewhere.\n";
+	return false;
+#endif
+}
 
-		file->put(desc.BoundResources); *outputlength += 1;
-		for (unsigned i = 0; i < desc.BoundResources; ++i) {
-			D3D11_SHADER_INPUT_BIND_DESC bindDesc;
-			reflector->GetResourceBindingDesc(i, &bindDesc);
-			(*file) << bindDesc.Name; *outputlength += strlen(bindDesc.Name);
-			file->put(0); *outputlength += 1;
-			file->put(bindDesc.BindPoint); *outputlength += 1;
-		}
+int compileHLSLToD3D11(const char* from, const char* to, const char* source, char* output, int* outputlength, const krafix::D3DContainer& container, EShLanguage stage, int shaderModel, bool debug,
+	krafix::D3DBytecodeCompiler compileBytecode) {
+	std::vector<char> bytecode;
+	std::string errors;
+	if (!compileBytecode(from, source, shaderString(stage, shaderModel / 10), debug, bytecode, errors)) {
+		std::cerr << errors;
+		return 1;
+	}
 
-		ID3D11ShaderReflectionConstantBuffer* constants = reflector->GetConstantBufferByName("$Globals");
-		D3D11_SHADER_BUFFER_DESC bufferDesc;
-		hr = constants->GetDesc(&bufferDesc);
-		if (hr == S_OK) {
-			file->put(bufferDesc.Variables); *outputlength += 1;
-			for (unsigned i = 0; i < bufferDesc.Variables; ++i) {
-				ID3D11ShaderReflectionVariable* variable = constants->GetVariableByIndex(i);
-				D3D11_SHADER_VARIABLE_DESC variableDesc;
-				hr = variable->GetDesc(&variableDesc);
-				if (hr == S_OK) {
-					(*file) << variableDesc.Name; *outputlength += strlen(variableDesc.Name);
-					file->put(0); *outputlength += 1;
-					file->write((char*)&variableDesc.StartOffset, 4); *outputlength += 4;
-					file->write((char*)&variableDesc.Size, 4); *outputlength += 4;
-					D3D11_SHADER_TYPE_DESC typeDesc;
-					hr = variable->GetType()->GetDesc(&typeDesc);
-					if (hr == S_OK) {
-						file->put(typeDesc.Columns); *outputlength += 1;
-						file->put(typeDesc.Rows); *outputlength += 1;
-					}
-					else {
-						file->put(0); *outputlength += 1;
-						file->put(0); *outputlength += 1;
-					}
-				}
-			}
-		}
-		else {
-			file->put(0); *outputlength += 1;
-		}
-		file->write((char*)shaderBuffer->GetBufferPointer(), shaderBuffer->GetBufferSize()); *outputlength += shaderBuffer->GetBufferSize();
-		return 0;
+	std::string data = krafix::writeD3D11Container(container, bytecode);
+	*outputlength = (int)data.size();
+	if (output) {
+		memcpy(output, data.data(), data.size());
 	}
 	else {
-		std::cerr.write((char*)errorMessage->GetBufferPointer(), errorMessage->GetBufferSize());
-		return 1;
+		std::ofstream file(to, std::ios_base::binary);
+		file.write(data.data(), data.size());
 	}
-#else
-	return 1;
-#endif
+	return 0;
 }
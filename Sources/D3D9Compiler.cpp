@@ -1,6 +1,8 @@
+#include "D3DContainer.h"
 #include "../glslang/glslang/Public/ShaderLang.h"
 #include <map>
 #include <string>
+#include <vector>
 
 #ifdef _WIN32
 
@@ -18,7 +20,7 @@ static D3DXCompileShaderFromFileAType CompileShaderFromFileA = nullptr;
 
 #endif
 
-int compileHLSLToD3D9(const char* from, const char* to, const char* source, char* output, int* outputlength, const std::map<std::string, int>& attributes, EShLanguage stage) {
+int compileHLSLToD3D9(const char* from, const char* to, const char* source, char* output, int* outputlength, const krafix::D3DContainer& reflected, EShLanguage stage, int shaderModel) {
 #ifdef _WIN32
 	HMODULE lib = LoadLibraryA("d3dx9_43.dll");
 	if (lib != nullptr) CompileShaderFromFileA = (D3DXCompileShaderFromFileAType)GetProcAddress(lib, "D3DXCompileShaderFromFileA");
@@ -31,22 +33,18 @@ int compileHLSLToD3D9(const char* from, const char* to, const char* source, char
 	LPD3DXBUFFER errors;
 	LPD3DXBUFFER shader;
 	LPD3DXCONSTANTTABLE table;
-	HRESULT hr = CompileShaderFromFileA(from, nullptr, nullptr, "main", stage == EShLangVertex ? "vs_2_0" : "ps_2_0", 0, &shader, &errors, &table);
-	if (FAILED(hr)) hr = CompileShaderFromFileA(from, nullptr, nullptr, "main", stage == EShLangVertex ? "vs_3_0" : "ps_3_0", 0, &shader, &errors, &table);
+	const char* profile;
+	if (shaderModel >= 30) profile = stage == EShLangVertex ? "vs_3_0" : "ps_3_0";
+	else profile = stage == EShLangVertex ? "vs_2_0" : "ps_2_0";
+	HRESULT hr = CompileShaderFromFileA(from, nullptr, nullptr, "main", profile, 0, &shader, &errors, &table);
 	if (errors != nullptr) std::cerr << (char*)errors->GetBufferPointer();
 	if (!FAILED(hr)) {
-		std::ofstream file(to, std::ios_base::binary);
-
-		file.put((char)attributes.size());
-		for (std::map<std::string, int>::const_iterator attribute = attributes.begin(); attribute != attributes.end(); ++attribute) {
-			file << attribute->first.c_str();
-			file.put(0);
-			file.put(attribute->second);
-		}
+		// Register assignment is up to D3DX, so D3D9 takes the constants from its table instead of from SPIR-V
+		krafix::D3DContainer container = reflected;
+		container.registers.clear();
 
 		D3DXCONSTANTTABLE_DESC desc;
 		table->GetDesc(&desc);
-		file.put(desc.Constants);
 		for (UINT i = 0; i < desc.Constants; ++i) {
 			D3DXHANDLE handle = table->GetConstant(nullptr, i);
 			D3DXCONSTANT_DESC descriptions[10];
@@ -69,23 +67,18 @@ int compileHLSLToD3D9(const char* from, const char* to, const char* source, char
 					regtype = 's';
 					break;
 				}
-				//std::cout << descriptions[i2].Name << " " << regtype << descriptions[i2].RegisterIndex << " " << descriptions[i2].RegisterCount << std::endl;
-				file << descriptions[i2].Name;
-				file.put(0);
-				file.put(regtype);
-				file.put(descriptions[i2].RegisterIndex);
-				file.put(descriptions[i2].RegisterCount);
+				krafix::D3D9Constant constant;
+				constant.name = descriptions[i2].Name;
+				constant.registerSet = regtype;
+				constant.registerIndex = descriptions[i2].RegisterIndex;
+				constant.registerCount = descriptions[i2].RegisterCount;
+				container.registers.push_back(constant);
 			}
 		}
-		DWORD* data = (DWORD*)shader->GetBufferPointer();
-		for (unsigned i = 0; i < shader->GetBufferSize() / 4; ++i) {
-			if ((data[i] & 0xffff) == 0xfffe) { //comment token
-				unsigned size = (data[i] >> 16) & 0xffff;
-				i += size;
-			}
-			else file.write((char*)&data[i], 4);
-		}
-		//file.write((char*)shader->GetBufferPointer(), shader->GetBufferSize());
+		std::vector<char> bytecode((char*)shader->GetBufferPointer(), (char*)shader->GetBufferPointer() + shader->GetBufferSize());
+		std::string data = krafix::writeD3D9Container(container, bytecode);
+		std::ofstream file(to, std::ios_base::binary);
+		file.write(data.data(), data.size());
 		return 0;
 	}
 	else {
@@ -0,0 +1,69 @@
+#include "D3DContainer.h"
+#include "Serialization.h"
+
+#include <cstdint>
+
+using namespace krafix;
+
+namespace {
+	void writeString(std::string& out, const std::string& text) {
+		out += text;
+		out += '\0';
+	}
+
+	void writeAttributes(std::string& out, const std::map<std::string, int>& attributes) {
+		out += (char)attributes.size();
+		for (auto& attribute : attributes) {
+			writeString(out, attribute.first);
+			out += (char)attribute.second;
+		}
+	}
+}
+
+std::string krafix::writeD3D11Container(const D3DContainer& container, const std::vector<char>& bytecode) {
+	std::string out;
+	writeAttributes(out, container.attributes);
+
+	out += (char)container.resources.size();
+	for (auto& resource : container.resources) {
+		writeString(out, resource.name);
+		out += (char)resource.bindPoint;
+	}
+
+	out += (char)container.constants.size();
+	for (auto& constant : container.constants) {
+		writeString(out, constant.name);
+		writeWord(out, constant.offset);
+		writeWord(out, constant.size);
+		out += (char)constant.columns;
+		out += (char)constant.rows;
+	}
+
+	out.append(bytecode.begin(), bytecode.end());
+	return out;
+}
+
+std::string krafix::writeD3D9Container(const D3DContainer& container, const std::vector<char>& bytecode) {
+	std::string out;
+	writeAttributes(out, container.attributes);
+
+	out += (char)container.registers.size();
+	for (auto& constant : container.registers) {
+		writeString(out, constant.name);
+		out += constant.registerSet;
+		out += (char)constant.registerIndex;
+		out += (char)constant.registerCount;
+	}
+
+	// Comment tokens hold the constant table and debug data the runtime does not need
+	for (size_t i = 0; i + 4 <= bytecode.size(); i += 4) {
+		uint32_t token = (uint8_t)bytecode[i] | ((uint8_t)bytecode[i + 1] << 8) | ((uint8_t)bytecode[i + 2] << 16) | ((uint32_t)(uint8_t)bytecode[i + 3] << 24);
+		if ((token & 0xffff) == 0xfffe) {
+			i += ((token >> 16) & 0xffff) * 4;
+		}
+		else {
+			out.append(bytecode.begin() + i, bytecode.begin() + i + 4);
+		}
+	}
+	return out;
+}
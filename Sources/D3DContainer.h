@@ -0,0 +1,50 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace krafix {
+	struct D3DResource {
+		std::string name;
+		unsigned bindPoint = 0;
+	};
+
+	// A member of the D3D11 $Globals constant buffer
+	struct D3DConstant {
+		std::string name;
+		unsigned offset = 0;
+		unsigned size = 0;
+		unsigned columns = 0;
+		unsigned rows = 0;
+	};
+
+	// A D3D9 constant table entry, registerSet is one of 'b', 'i', 'f' or 's'
+	struct D3D9Constant {
+		std::string name;
+		char registerSet = 'f';
+		unsigned registerIndex = 0;
+		unsigned registerCount = 0;
+	};
+
+	// Everything Kore reads in front of the bytecode
+	struct D3DContainer {
+		std::map<std::string, int> attributes;
+		std::vector<D3DResource> resources;
+		std::vector<D3DConstant> constants;
+		std::vector<D3D9Constant> registers;
+	};
+
+	// Compiles an HLSL file, or source when it is not null, to bytecode for profile. Returns false and fills errors on
+	// failure. The default implementation uses D3DCompile and only exists on Windows.
+	typedef bool (*D3DBytecodeCompiler)(const char* hlslFile, const char* source, const char* profile, bool debug, std::vector<char>& bytecode, std::string& errors);
+
+	// Attribute count, name/index pairs, bound resource count, name/bind point pairs, $Globals member count, name,
+	// offset, size, columns and rows per member, then the bytecode. Counts, indices, bind points, columns and rows are
+	// single bytes, offsets and sizes little endian uint32.
+	std::string writeD3D11Container(const D3DContainer& container, const std::vector<char>& bytecode);
+
+	// Attribute table, constant count and name, register set, index and count per constant, then the bytecode
+	// without its comment tokens
+	std::string writeD3D9Container(const D3DContainer& container, const std::vector<char>& bytecode);
+}
@@ -0,0 +1,209 @@
+#include "DescriptorPlan.h"
+#include "Serialization.h"
+#include "SpirVModule.h"
+
+#include <SPIRV/spirv.hpp>
+
+#include <algorithm>
+#include <fstream>
+
+using namespace krafix;
+
+const char* krafix::globalUniformBufferName = "_k_global_uniform_buffer";
+
+namespace {
+	using namespace spv;
+
+	const char* frequencyNames[] = { "frame", "material", "draw" };
+
+	struct Resource {
+		std::string name;
+		std::string type;
+		uint32_t count;
+	};
+
+	// Opaque resources and whether there are loose uniforms which SpirVTranslator gathers in the global uniform buffer
+	std::vector<Resource> stageResources(const std::vector<uint32_t>& spirv, bool& hasUniforms, std::string& errors) {
+		SpirVModule module(spirv);
+		std::map<uint32_t, std::string> names = module.names();
+		std::map<uint32_t, uint32_t> constants;
+		std::map<uint32_t, uint32_t> pointees;
+		std::vector<Resource> resources;
+		hasUniforms = false;
+		for (auto& instruction : module.instructions) {
+			uint32_t op = SpirVModule::opcode(instruction);
+			// Specialization constants size the array with their default like in SpirVTranslator
+			if (op == OpConstant || op == OpSpecConstant) {
+				constants[instruction[2]] = instruction[3];
+			}
+			else if (op == OpTypePointer) {
+				pointees[instruction[1]] = instruction[3];
+			}
+			else if (op == OpVariable && instruction[3] == StorageClassUniformConstant && names[instruction[2]] != "") {
+				Resource resource;
+				resource.name = names[instruction[2]];
+				resource.count = 1;
+				const std::vector<uint32_t>* type = module.findType(pointees[instruction[1]]);
+				if (type != nullptr && SpirVModule::opcode(*type) == OpTypeArray) {
+					resource.count = constants[(*type)[3]];
+					type = module.findType((*type)[2]);
+					if (resource.count == 0) {
+						errors += "Error: array size of " + resource.name + " is not a constant.\n";
+						continue;
+					}
+				}
+				uint32_t typeOp = type == nullptr ? 0 : SpirVModule::opcode(*type);
+				if (typeOp == OpTypeSampledImage) resource.type = "combinedImageSampler";
+				else if (typeOp == OpTypeImage) resource.type = (*type)[7] == 2 ? "storageImage" : "sampledImage";
+				else if (typeOp == OpTypeSampler) resource.type = "sampler";
+				else {
+					hasUniforms = true;
+					continue;
+				}
+				resources.push_back(resource);
+			}
+		}
+		return resources;
+	}
+}
+
+std::vector<DescriptorBinding> krafix::planDescriptors(const std::map<ShaderStage, std::vector<uint32_t>>& stages, const std::map<std::string, UpdateFrequency>& frequencies, std::string& errors) {
+	std::vector<DescriptorBinding> plan;
+	for (auto& stage : stages) {
+		bool hasUniforms = false;
+		std::vector<Resource> resources = stageResources(stage.second, hasUniforms, errors);
+		if (hasUniforms) {
+			// Every stage has a buffer of its own
+			DescriptorBinding buffer;
+			buffer.name = globalUniformBufferName;
+			buffer.type = "uniformBuffer";
+			buffer.set = UpdatePerDraw;
+			buffer.stages.push_back(stage.first);
+			plan.push_back(buffer);
+		}
+		for (auto& resource : resources) {
+			auto existing = std::find_if(plan.begin(), plan.end(), [&resource](const DescriptorBinding& binding) { return binding.name == resource.name; });
+			if (existing != plan.end() && existing->type == resource.type) {
+				existing->stages.push_back(stage.first);
+				continue;
+			}
+			DescriptorBinding binding;
+			binding.name = resource.name;
+			binding.type = resource.type;
+			binding.set = UpdatePerMaterial;
+			binding.count = resource.count;
+			binding.stages.push_back(stage.first);
+			plan.push_back(binding);
+		}
+	}
+
+	for (auto& binding : plan) {
+		auto frequency = frequencies.find(binding.name);
+		if (frequency != frequencies.end()) binding.set = frequency->second;
+	}
+
+	// Uniform buffers first, then the rest by name, so equal inputs always give equal layouts
+	std::stable_sort(plan.begin(), plan.end(), [](const DescriptorBinding& a, const DescriptorBinding& b) {
+		if (a.set != b.set) return a.set < b.set;
+		bool aBuffer = a.type == "uniformBuffer";
+		bool bBuffer = b.type == "uniformBuffer";
+		if (aBuffer != bBuffer) return aBuffer;
+		return a.name < b.name;
+	});
+	uint32_t nextBinding[3] = { 0, 0, 0 };
+	for (auto& binding : plan) {
+		binding.binding = nextBinding[binding.set];
+		nextBinding[binding.set] += binding.count;
+	}
+	return plan;
+}
+
+const DescriptorBinding* krafix::findDescriptor(const std::vector<DescriptorBinding>& plan, const std::string& name, ShaderStage stage) {
+	for (auto& binding : plan) {
+		if (binding.name == name && std::find(binding.stages.begin(), binding.stages.end(), stage) != binding.stages.end()) {
+			return &binding;
+		}
+	}
+	return nullptr;
+}
+
+bool krafix::parseUpdateFrequency(const std::string& text, UpdateFrequency& frequency) {
+	for (int i = 0; i < 3; ++i) {
+		if (text == frequencyNames[i]) {
+			frequency = (UpdateFrequency)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+void krafix::writeDescriptorLayoutJson(const char* filename, const std::vector<DescriptorBinding>& plan) {
+	std::ofstream out;
+	out.open(filename, std::ios::binary | std::ios::out);
+
+	out << "{\n\t\"sets\": [\n";
+	for (uint32_t set = 0; set < 3; ++set) {
+		out << "\t\t{\n\t\t\t\"set\": " << set << ",\n\t\t\t\"frequency\": \"" << frequencyNames[set] << "\",\n\t\t\t\"bindings\": [";
+		bool first = true;
+		for (auto& binding : plan) {
+			if (binding.set != set) continue;
+			out << (first ? "\n" : ",\n");
+			first = false;
+			out << "\t\t\t\t{ \"name\": \"" << escapeJson(binding.name) << "\", \"type\": \"" << binding.type << "\", \"binding\": " << binding.binding
+				<< ", \"count\": " << binding.count << ", \"stages\": [";
+			for (size_t i = 0; i < binding.stages.size(); ++i) {
+				out << (i > 0 ? ", " : "") << "\"" << stageName(binding.stages[i]) << "\"";
+			}
+			out << "] }";
+		}
+		out << (first ? "]\n" : "\n\t\t\t]\n") << "\t\t}" << (set < 2 ? ",\n" : "\n");
+	}
+	out << "\t]\n}\n";
+}
+
+uint32_t krafix::argumentBufferSet(uint32_t frequency) {
+	return frequency + 1;
+}
+
+uint32_t krafix::argumentBufferIndex(uint32_t frequency) {
+	return frequency + 2;
+}
+
+void krafix::findArgumentIds(const std::vector<DescriptorBinding>& plan, const DescriptorBinding& descriptor, uint32_t& id, uint32_t& samplerId) {
+	uint32_t next = 0;
+	for (auto& binding : plan) {
+		if (binding.set != descriptor.set || binding.type == "uniformBuffer") continue;
+		id = next;
+		next += binding.count;
+		samplerId = binding.type == "combinedImageSampler" ? next : id;
+		if (binding.type == "combinedImageSampler") next += binding.count;
+		if (&binding == &descriptor) return;
+	}
+}
+
+void krafix::writeArgumentBufferLayoutJson(const char* filename, const std::vector<DescriptorBinding>& plan) {
+	std::ofstream out;
+	out.open(filename, std::ios::binary | std::ios::out);
+
+	out << "{\n\t\"argumentBuffers\": [\n";
+	for (uint32_t set = 0; set < 3; ++set) {
+		out << "\t\t{\n\t\t\t\"frequency\": \"" << frequencyNames[set] << "\",\n\t\t\t\"buffer\": " << argumentBufferIndex(set) << ",\n\t\t\t\"resources\": [";
+		bool first = true;
+		for (auto& binding : plan) {
+			if (binding.set != set || binding.type == "uniformBuffer") continue;
+			uint32_t id = 0, samplerId = 0;
+			findArgumentIds(plan, binding, id, samplerId);
+			out << (first ? "\n" : ",\n");
+			first = false;
+			out << "\t\t\t\t{ \"name\": \"" << escapeJson(binding.name) << "\", \"type\": \"" << binding.type << "\", \"id\": " << id;
+			if (binding.type == "combinedImageSampler") out << ", \"samplerId\": " << samplerId;
+			out << ", \"count\": " << binding.count << ", \"stages\": [";
+			for (size_t i = 0; i < binding.stages.size(); ++i) {
+				out << (i > 0 ? ", " : "") << "\"" << stageName(binding.stages[i]) << "\"";
+			}
+			out << "] }";
+		}
+		out << (first ? "]\n" : "\n\t\t\t]\n") << "\t\t}" << (set < 2 ? ",\n" : "\n");
+	}
+	out << "\t]\n}\n";
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Translator.h"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace krafix {
+	// Every frequency gets its own descriptor set, the set index is the enum value
+	enum UpdateFrequency {
+		UpdatePerFrame,
+		UpdatePerMaterial,
+		UpdatePerDraw
+	};
+
+	struct DescriptorBinding {
+		std::string name;
+		std::string type;
+		uint32_t set = 0;
+		uint32_t binding = 0;
+		uint32_t count = 1;
+		std::vector<ShaderStage> stages;
+	};
+
+	// Assigns the global uniform buffer of every stage and all samplers and images of a pipeline to the
+	// set of their update frequency. Uniform buffers default to per draw, textures to per material.
+	// Resources of the same name share one binding in all stages using them. Arrays without a constant size are
+	// reported in errors.
+	std::vector<DescriptorBinding> planDescriptors(const std::map<ShaderStage, std::vector<uint32_t>>& stages, const std::map<std::string, UpdateFrequency>& frequencies, std::string& errors);
+	const DescriptorBinding* findDescriptor(const std::vector<DescriptorBinding>& plan, const std::string& name, ShaderStage stage);
+	bool parseUpdateFrequency(const std::string& text, UpdateFrequency& frequency);
+	void writeDescriptorLayoutJson(const char* filename, const std::vector<DescriptorBinding>& plan);
+
+	// Metal argument buffers hold the textures and samplers of one frequency. The global uniform buffer stays a
+	// discrete buffer in descriptor set 0, so the argument buffer of a frequency uses the descriptor set frequency + 1
+	// and the buffer index frequency + 2, above the vertex and uniform buffers.
+	uint32_t argumentBufferSet(uint32_t frequency);
+	uint32_t argumentBufferIndex(uint32_t frequency);
+	// [[id(n)]] of a resource in its argument buffer, combined image samplers get a second id for the sampler
+	void findArgumentIds(const std::vector<DescriptorBinding>& plan, const DescriptorBinding& descriptor, uint32_t& id, uint32_t& samplerId);
+	void writeArgumentBufferLayoutJson(const char* filename, const std::vector<DescriptorBinding>& plan);
+
+	extern const char* globalUniformBufferName;
+}
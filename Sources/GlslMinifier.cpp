@@ -0,0 +1,352 @@
+#include "GlslMinifier.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <vector>
+
+using namespace krafix;
+
+namespace {
+	// Keywords, reserved words, types and built-in functions of all GLSL and ESSL versions. Short names must not
+	// collide with them, declarations are recognized by the types.
+	const char* typeWords =
+		"void bool int uint float double vec2 vec3 vec4 ivec2 ivec3 ivec4 uvec2 uvec3 uvec4 bvec2 bvec3 bvec4 dvec2 dvec3 dvec4 "
+		"mat2 mat3 mat4 mat2x2 mat2x3 mat2x4 mat3x2 mat3x3 mat3x4 mat4x2 mat4x3 mat4x4 dmat2 dmat3 dmat4 dmat2x2 dmat2x3 dmat2x4 "
+		"dmat3x2 dmat3x3 dmat3x4 dmat4x2 dmat4x3 dmat4x4 sampler1D sampler2D sampler3D samplerCube sampler2DRect sampler1DArray "
+		"sampler2DArray samplerCubeArray samplerBuffer sampler2DMS sampler2DMSArray sampler1DShadow sampler2DShadow "
+		"sampler2DRectShadow sampler1DArrayShadow sampler2DArrayShadow samplerCubeShadow samplerCubeArrayShadow samplerExternalOES "
+		"isampler1D isampler2D isampler3D isamplerCube isampler2DRect isampler1DArray isampler2DArray isamplerCubeArray "
+		"isamplerBuffer isampler2DMS isampler2DMSArray usampler1D usampler2D usampler3D usamplerCube usampler2DRect "
+		"usampler1DArray usampler2DArray usamplerCubeArray usamplerBuffer usampler2DMS usampler2DMSArray image1D image2D image3D "
+		"imageCube image2DRect image1DArray image2DArray imageCubeArray imageBuffer image2DMS image2DMSArray iimage1D iimage2D "
+		"iimage3D iimageCube iimage2DRect iimage1DArray iimage2DArray iimageCubeArray iimageBuffer iimage2DMS iimage2DMSArray "
+		"uimage1D uimage2D uimage3D uimageCube uimage2DRect uimage1DArray uimage2DArray uimageCubeArray uimageBuffer uimage2DMS "
+		"uimage2DMSArray atomic_uint";
+
+	const char* reservedWords =
+		"attribute const uniform varying buffer shared coherent volatile restrict readonly writeonly layout centroid flat smooth "
+		"noperspective patch sample subroutine break continue do for while switch case default if else in out inout true false "
+		"invariant precise discard return struct precision lowp mediump highp common partition active asm class union enum "
+		"typedef template this resource goto inline noinline public static extern external interface long short half fixed "
+		"unsigned superp input output hvec2 hvec3 hvec4 fvec2 fvec3 fvec4 sampler3DRect filter sizeof cast namespace using main "
+		"radians degrees sin cos tan asin acos atan sinh cosh tanh asinh acosh atanh pow exp log exp2 log2 sqrt inversesqrt abs "
+		"sign floor trunc round roundEven ceil fract mod modf min max clamp mix step smoothstep isnan isinf floatBitsToInt "
+		"floatBitsToUint intBitsToFloat uintBitsToFloat fma frexp ldexp packUnorm2x16 packSnorm2x16 packUnorm4x8 packSnorm4x8 "
+		"unpackUnorm2x16 unpackSnorm2x16 unpackUnorm4x8 unpackSnorm4x8 packHalf2x16 unpackHalf2x16 packDouble2x32 "
+		"unpackDouble2x32 length distance dot cross normalize ftransform faceforward reflect refract matrixCompMult outerProduct "
+		"transpose determinant inverse lessThan lessThanEqual greaterThan greaterThanEqual equal notEqual any all not uaddCarry "
+		"usubBorrow umulExtended imulExtended bitfieldExtract bitfieldInsert bitfieldReverse bitCount findLSB findMSB textureSize "
+		"textureQueryLod textureQueryLevels textureSamples texture textureProj textureLod textureOffset texelFetch "
+		"texelFetchOffset textureProjOffset textureLodOffset textureProjLod textureProjLodOffset textureGrad textureGradOffset "
+		"textureProjGrad textureProjGradOffset textureGather textureGatherOffset textureGatherOffsets texture1D texture1DProj "
+		"texture1DLod texture1DProjLod texture2D texture2DProj texture2DLod texture2DProjLod texture2DLodEXT "
+		"texture2DProjLodEXT texture2DGradEXT texture2DProjGradEXT texture3D texture3DProj texture3DLod texture3DProjLod "
+		"textureCube textureCubeLod textureCubeLodEXT textureCubeGradEXT shadow1D shadow2D shadow1DProj shadow2DProj "
+		"shadow1DLod shadow2DLod shadow1DProjLod shadow2DProjLod shadow2DEXT shadow2DProjEXT atomicCounterIncrement "
+		"atomicCounterDecrement atomicCounter atomicAdd atomicMin atomicMax atomicAnd atomicOr atomicXor atomicExchange "
+		"atomicCompSwap imageSize imageSamples imageLoad imageStore imageAtomicAdd imageAtomicMin imageAtomicMax imageAtomicAnd "
+		"imageAtomicOr imageAtomicXor imageAtomicExchange imageAtomicCompSwap dFdx dFdy dFdxFine dFdyFine dFdxCoarse dFdyCoarse "
+		"fwidth fwidthFine fwidthCoarse interpolateAtCentroid interpolateAtSample interpolateAtOffset noise1 noise2 noise3 noise4 "
+		"EmitStreamVertex EndStreamPrimitive EmitVertex EndPrimitive barrier memoryBarrier memoryBarrierAtomicCounter "
+		"memoryBarrierBuffer memoryBarrierShared memoryBarrierImage groupMemoryBarrier";
+
+	// Only global declarations with these qualifiers are part of the interface
+	const char* interfaceWords = "attribute varying uniform in out inout buffer shared";
+
+	const char* operators[] = { "<<=", ">>=", "++", "--", "<<", ">>", "<=", ">=", "==", "!=", "&&", "||", "^^", "+=", "-=", "*=", "/=", "%=",
+		"&=", "|=", "^=", "//", "/*" };
+
+	std::set<std::string> wordSet(const char* words) {
+		std::set<std::string> set;
+		std::istringstream stream(words);
+		std::string word;
+		while (stream >> word) set.insert(word);
+		return set;
+	}
+
+	enum TokenKind {
+		TokenIdentifier,
+		TokenNumber,
+		TokenOperator,
+		TokenPreprocessor
+	};
+
+	struct Token {
+		TokenKind kind;
+		std::string text;
+	};
+
+	bool isWordChar(char c) {
+		return isalnum((unsigned char)c) || c == '_';
+	}
+
+	std::vector<Token> tokenize(const std::string& source) {
+		std::vector<Token> tokens;
+		bool lineStart = true;
+		size_t i = 0;
+		while (i < source.size()) {
+			char c = source[i];
+			if (c == '\n') {
+				lineStart = true;
+				++i;
+			}
+			else if (isspace((unsigned char)c)) {
+				++i;
+			}
+			else if (source.compare(i, 2, "//") == 0) {
+				while (i < source.size() && source[i] != '\n') ++i;
+			}
+			else if (source.compare(i, 2, "/*") == 0) {
+				size_t end = source.find("*/", i + 2);
+				i = end == std::string::npos ? source.size() : end + 2;
+			}
+			else if (c == '#' && lineStart) {
+				// Directives keep their words, runs of whitespace and continued lines collapse to single spaces
+				std::string directive;
+				while (i < source.size() && source[i] != '\n') {
+					if (source[i] == '\\' && i + 1 < source.size() && source[i + 1] == '\n') {
+						i += 2;
+						directive += ' ';
+					}
+					else if (source.compare(i, 2, "//") == 0) {
+						while (i < source.size() && source[i] != '\n') ++i;
+					}
+					else {
+						directive += isspace((unsigned char)source[i]) ? ' ' : source[i];
+						++i;
+					}
+				}
+				std::string collapsed;
+				for (char d : directive) {
+					if (d == ' ' && (collapsed.empty() || collapsed.back() == ' ')) continue;
+					collapsed += d;
+				}
+				while (!collapsed.empty() && collapsed.back() == ' ') collapsed.pop_back();
+				tokens.push_back({ TokenPreprocessor, collapsed });
+			}
+			else if (isalpha((unsigned char)c) || c == '_') {
+				size_t start = i;
+				while (i < source.size() && isWordChar(source[i])) ++i;
+				tokens.push_back({ TokenIdentifier, source.substr(start, i - start) });
+				lineStart = false;
+			}
+			else if (isdigit((unsigned char)c) || (c == '.' && i + 1 < source.size() && isdigit((unsigned char)source[i + 1]))) {
+				size_t start = i;
+				bool hex = source.compare(i, 2, "0x") == 0 || source.compare(i, 2, "0X") == 0;
+				while (i < source.size()) {
+					char d = source[i];
+					if (isWordChar(d) || d == '.') {
+						++i;
+					}
+					else if ((d == '+' || d == '-') && !hex && (source[i - 1] == 'e' || source[i - 1] == 'E')) {
+						++i;
+					}
+					else {
+						break;
+					}
+				}
+				tokens.push_back({ TokenNumber, source.substr(start, i - start) });
+				lineStart = false;
+			}
+			else {
+				std::string op(1, c);
+				for (const char* candidate : operators) {
+					size_t length = strlen(candidate);
+					if (length > op.size() && source.compare(i, length, candidate) == 0) op = candidate;
+				}
+				i += op.size();
+				tokens.push_back({ TokenOperator, op });
+				lineStart = false;
+			}
+		}
+		return tokens;
+	}
+
+	// a..z, A..Z, then longer names without underscores so they never form reserved double underscores
+	std::string shortName(unsigned index) {
+		const char* first = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+		const char* rest = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+		if (index < 52) return std::string(1, first[index]);
+		index -= 52;
+		unsigned count = 52 * 62;
+		size_t length = 2;
+		while (index >= count) {
+			index -= count;
+			count *= 62;
+			++length;
+		}
+		std::string name(length, ' ');
+		for (size_t i = length - 1; i > 0; --i) {
+			name[i] = rest[index % 62];
+			index /= 62;
+		}
+		name[0] = first[index];
+		return name;
+	}
+
+	bool needsSpace(const std::string& previous, const std::string& next) {
+		if (previous.empty() || next.empty()) return false;
+		if (isWordChar(previous.back()) && isWordChar(next[0])) return true;
+		std::string joined = previous + next[0];
+		for (const char* op : operators) {
+			if (std::string(op).compare(0, joined.size(), joined) == 0) return true;
+		}
+		return false;
+	}
+}
+
+std::string krafix::minifyGlsl(const std::string& source, std::map<std::string, std::string>& names) {
+	static const std::set<std::string> types = wordSet(typeWords);
+	static const std::set<std::string> reserved = wordSet(reservedWords);
+	static const std::set<std::string> interfaceQualifiers = wordSet(interfaceWords);
+
+	std::vector<Token> tokens = tokenize(source);
+	std::set<std::string> identifiers;
+	std::set<std::string> preserved;
+	std::set<std::string> structs;
+	for (size_t i = 0; i < tokens.size(); ++i) {
+		if (tokens[i].kind == TokenIdentifier) {
+			identifiers.insert(tokens[i].text);
+			if (i > 0 && tokens[i - 1].text == "struct") structs.insert(tokens[i].text);
+		}
+		else if (tokens[i].kind == TokenPreprocessor) {
+			for (auto& token : tokenize(tokens[i].text.substr(1))) {
+				if (token.kind != TokenIdentifier) continue;
+				identifiers.insert(token.text);
+				preserved.insert(token.text);
+			}
+		}
+	}
+
+	// Struct and block bodies are aggregates, global statements with an interface qualifier keep all their names
+	std::vector<Token*> code;
+	for (auto& token : tokens) {
+		if (token.kind != TokenPreprocessor) code.push_back(&token);
+	}
+	std::vector<bool> inAggregate(code.size(), false);
+	std::vector<bool> braces;
+	int aggregates = 0;
+	int parens = 0;
+	size_t statementStart = 0;
+	bool interface = false;
+	auto finishStatement = [&](size_t end) {
+		if (interface) {
+			for (size_t i = statementStart; i < end; ++i) {
+				if (code[i]->kind == TokenIdentifier) preserved.insert(code[i]->text);
+			}
+		}
+		interface = false;
+		statementStart = end;
+	};
+	for (size_t i = 0; i < code.size(); ++i) {
+		const std::string& text = code[i]->text;
+		if (braces.empty()) {
+			if (text == "(") ++parens;
+			else if (text == ")") --parens;
+			else if (parens == 0 && interfaceQualifiers.count(text) != 0) interface = true;
+		}
+		if (text == "{") {
+			bool aggregate = i > 0 && code[i - 1]->kind == TokenIdentifier && code[i - 1]->text != "else" && code[i - 1]->text != "do";
+			if (braces.empty() && !aggregate) finishStatement(i);
+			braces.push_back(aggregate);
+			if (aggregate) ++aggregates;
+		}
+		else if (text == "}" && !braces.empty()) {
+			bool aggregate = braces.back();
+			braces.pop_back();
+			if (aggregate) --aggregates;
+			else if (braces.empty()) statementStart = i + 1;
+		}
+		else if (text == ";" && braces.empty()) {
+			finishStatement(i + 1);
+		}
+		inAggregate[i] = aggregates > 0;
+	}
+
+	// A declaration is a name after a type that is followed by an initializer, a terminator, an array size or a parameter list
+	std::set<std::string> declared;
+	for (size_t i = 0; i < code.size(); ++i) {
+		if (code[i]->kind != TokenIdentifier || types.count(code[i]->text) != 0 || reserved.count(code[i]->text) != 0) continue;
+		const std::string& previous = i > 0 ? code[i - 1]->text : "";
+		const std::string& next = i + 1 < code.size() ? code[i + 1]->text : "";
+		if (previous == "." || inAggregate[i]) {
+			if (structs.count(code[i]->text) == 0 || previous == ".") preserved.insert(code[i]->text);
+		}
+		else if (previous == "struct") {
+			declared.insert(code[i]->text);
+		}
+		else if ((types.count(previous) != 0 || structs.count(previous) != 0)
+			&& (next == "=" || next == ";" || next == "," || next == "(" || next == "[" || next == ")")) {
+			declared.insert(code[i]->text);
+		}
+	}
+
+	std::map<std::string, unsigned> uses;
+	for (size_t i = 0; i < code.size(); ++i) {
+		const std::string& name = code[i]->text;
+		if (code[i]->kind != TokenIdentifier || declared.count(name) == 0 || preserved.count(name) != 0) continue;
+		if (name.compare(0, 3, "gl_") == 0) continue;
+		++uses[name];
+	}
+
+	// The most used names get the shortest replacements
+	std::vector<std::pair<std::string, unsigned>> order(uses.begin(), uses.end());
+	std::stable_sort(order.begin(), order.end(), [](const std::pair<std::string, unsigned>& a, const std::pair<std::string, unsigned>& b) {
+		return a.second > b.second;
+	});
+	names.clear();
+	unsigned index = 0;
+	for (auto& name : order) {
+		std::string replacement;
+		do {
+			replacement = shortName(index++);
+		} while (reserved.count(replacement) != 0 || types.count(replacement) != 0 || identifiers.count(replacement) != 0
+			|| replacement.compare(0, 3, "GL_") == 0);
+		names[name.first] = replacement;
+	}
+
+	std::string minified;
+	std::string previous;
+	for (size_t i = 0; i < tokens.size(); ++i) {
+		if (tokens[i].kind == TokenPreprocessor) {
+			if (!minified.empty() && minified.back() != '\n') minified += '\n';
+			minified += tokens[i].text;
+			minified += '\n';
+			previous.clear();
+			continue;
+		}
+		std::string text = tokens[i].text;
+		if (tokens[i].kind == TokenIdentifier && previous != ".") {
+			auto name = names.find(text);
+			if (name != names.end()) text = name->second;
+		}
+		if (needsSpace(previous, text)) minified += ' ';
+		minified += text;
+		previous = text;
+	}
+	if (!minified.empty() && minified.back() != '\n') minified += '\n';
+	return minified;
+}
+
+void krafix::writeNameMapJson(const char* filename, const std::map<std::string, std::string>& names) {
+	std::ofstream out;
+	out.open(filename, std::ios::binary | std::ios::out);
+
+	// Keyed by the short names because those are what shows up in driver error messages
+	std::map<std::string, std::string> reverse;
+	for (auto& name : names) reverse[name.second] = name.first;
+
+	out << "{";
+	bool first = true;
+	for (auto& name : reverse) {
+		out << (first ? "\n" : ",\n") << "\t\"" << name.first << "\": \"" << name.second << "\"";
+		first = false;
+	}
+	out << (first ? "}\n" : "\n}\n");
+
+	out.close();
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+namespace krafix {
+	// Removes comments and whitespace from GLSL/ESSL source and gives the functions, parameters, locals and
+	// non interface globals it declares short names. Attributes, varyings, uniforms, blocks, struct members
+	// and everything the preprocessor sees keep their names. names receives original name -> short name.
+	std::string minifyGlsl(const std::string& source, std::map<std::string, std::string>& names);
+
+	void writeNameMapJson(const char* filename, const std::map<std::string, std::string>& names);
+}
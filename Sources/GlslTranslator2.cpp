@@ -1,6 +1,12 @@
 #include "GlslTranslator2.h"
+#include "CrossIR.h"
+#include "GlslMinifier.h"
+#include "PrecisionAnalysis.h"
+#include "Serialization.h"
+#include "UniformBlock.h"
 #include "../SPIRV-Cross/spirv_glsl.hpp"
 #include <fstream>
+#include <memory>
 
 using namespace krafix;
 
@@ -21,7 +27,22 @@ void GlslTranslator2::outputCode(const Target& target, const char* sourcefilenam
 		}
 	}
 
-	spirv_cross::CompilerGLSL* compiler = new spirv_cross::CompilerGLSL(spirv);
+	// Uniform blocks need GLSL 1.40 or ESSL 3.00, blocks of different stages must not share a name
+	uniformBlocks.clear();
+	if (target.uniformBlocks && target.version >= (target.es ? 300 : 140)) {
+		std::string blockName = std::string("_k_") + stageName(stage) + "_uniforms";
+		UniformLayoutBlock block;
+		if (wrapUniformsInBlock(spirv, blockName, blockName + "_data", block)) {
+			uniformBlocks.push_back(block);
+		}
+	}
+
+	// Precision qualifiers only mean something in ESSL
+	if (target.autoPrecision && target.es) {
+		relaxPrecision(spirv);
+	}
+
+	std::unique_ptr<spirv_cross::CompilerGLSL> compiler(new spirv_cross::CompilerGLSL(*parseCrossIR(spirv, crossIR)));
 
 	compiler->set_entry_point("main", executionModel());
 	spirv_cross::CompilerGLSL::Options opts = compiler->get_common_options();
@@ -45,6 +66,10 @@ void GlslTranslator2::outputCode(const Target& target, const char* sourcefilenam
 	compiler->set_common_options(opts);
 
 	std::string glsl = compiler->compile();
+	minifiedNames.clear();
+	if (target.minify) {
+		glsl = minifyGlsl(glsl, minifiedNames);
+	}
 	if (output) {
 		strcpy(output, glsl.c_str());
 	}
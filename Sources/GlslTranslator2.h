@@ -1,12 +1,22 @@
 #pragma once
 
+#include "CrossIR.h"
 #include "Translator.h"
+#include "UniformLayout.h"
+
+#include <map>
+#include <string>
 
 namespace krafix {
 	class GlslTranslator2 : public Translator {
 	public:
 		GlslTranslator2(std::vector<unsigned>& spirv, ShaderStage stage, bool relax) : Translator(spirv, stage), relax(relax) {}
 		void outputCode(const Target& target, const char* sourcefilename, const char* filename, char* output, std::map<std::string, int>& attributes) override;
+		std::vector<UniformLayoutBlock> uniformBlocks;
+		// Original name -> short name of everything --minify renamed
+		std::map<std::string, std::string> minifiedNames;
+		// Owned by the driver, the module is parsed for this translator alone without one
+		CrossIRCache* crossIR = nullptr;
 	private:
 		bool relax;
 	};
@@ -1,10 +1,98 @@
 #include "HlslTranslator2.h"
+#include "CrossIR.h"
+#include "ShaderModel.h"
 #include "../SPIRV-Cross/spirv_hlsl.hpp"
 #include <fstream>
+#include <memory>
 #include <algorithm>
 
 using namespace krafix;
 
+namespace {
+	unsigned alignRegister(unsigned offset) {
+		return (offset + 15) & ~15u;
+	}
+
+	// In the order D3DReflect reports bound resources
+	enum RegisterClass {
+		SamplerRegister,
+		TextureRegister,
+		UavRegister,
+		BufferRegister
+	};
+
+	struct BoundResource {
+		spirv_cross::Resource resource;
+		RegisterClass registerClass;
+		// Combined image samplers take the same index of the texture and the sampler registers
+		bool combined;
+	};
+
+	class RegisterSpace {
+	public:
+		void reserve(unsigned binding, unsigned count) {
+			if (used.size() < binding + count) used.resize(binding + count, false);
+			for (unsigned i = binding; i < binding + count; ++i) used[i] = true;
+		}
+
+		bool isFree(unsigned binding, unsigned count) const {
+			for (unsigned i = binding; i < binding + count && i < used.size(); ++i) {
+				if (used[i]) return false;
+			}
+			return true;
+		}
+
+	private:
+		std::vector<bool> used;
+	};
+
+	bool isOpaque(const spirv_cross::SPIRType& type) {
+		return type.basetype == spirv_cross::SPIRType::Image || type.basetype == spirv_cross::SPIRType::SampledImage || type.basetype == spirv_cross::SPIRType::Sampler;
+	}
+
+	// Computes size, array and matrix stride of a type following the HLSL constant buffer packing rules
+	void layoutHlslType(spirv_cross::Compiler* compiler, const spirv_cross::SPIRType& type, UniformLayoutMember& member, bool& startsRegister) {
+		unsigned elementSize = 0;
+		startsRegister = false;
+		if (type.basetype == spirv_cross::SPIRType::Struct) {
+			unsigned offset = 0;
+			for (size_t i = 0; i < type.member_types.size(); ++i) {
+				UniformLayoutMember child;
+				bool childStartsRegister;
+				layoutHlslType(compiler, compiler->get_type(type.member_types[i]), child, childStartsRegister);
+				if (childStartsRegister || (offset % 16) + child.size > 16) {
+					offset = alignRegister(offset);
+				}
+				offset += child.size;
+			}
+			elementSize = offset;
+			startsRegister = true;
+		}
+		else if (type.columns > 1) {
+			// Every column is stored in its own register
+			elementSize = (type.columns - 1) * 16 + type.vecsize * 4;
+			member.matrixStride = 16;
+			startsRegister = true;
+		}
+		else {
+			elementSize = type.vecsize * 4;
+		}
+
+		if (type.array.size() > 0) {
+			unsigned count = 1;
+			for (auto length : type.array) {
+				count *= length;
+			}
+			member.arrayStride = alignRegister(elementSize);
+			member.size = count > 0 ? (count - 1) * member.arrayStride + elementSize : 0;
+			startsRegister = true;
+		}
+		else {
+			member.size = elementSize;
+		}
+	}
+}
+
 void HlslTranslator2::outputCode(const Target& target, const char* sourcefilename, const char* filename, char* output, std::map<std::string, int>& attributes) {
 	std::vector<unsigned> spirv;
 
@@ -22,7 +110,7 @@ void HlslTranslator2::outputCode(const Target& target, const char* sourcefilenam
 		}
 	}
 
-	spirv_cross::CompilerHLSL* compiler = new spirv_cross::CompilerHLSL(spirv);
+	std::unique_ptr<spirv_cross::CompilerHLSL> compiler(new spirv_cross::CompilerHLSL(*parseCrossIR(spirv, crossIR)));
 
 	compiler->set_entry_point("main", executionModel());
 
@@ -31,13 +119,63 @@ void HlslTranslator2::outputCode(const Target& target, const char* sourcefilenam
 	compiler->CompilerGLSL::set_common_options(glslOpts);
 
 	spirv_cross::CompilerHLSL::Options opts = compiler->get_hlsl_options();
+	// SPIRV-Cross writes the same HLSL for 2.0 and 3.0
+	shaderModel = inferShaderModel(spirv, stage, target.version <= 9);
+	opts.shader_model = std::max(shaderModel, 30);
+	compiler->set_hlsl_options(opts);
+
+	container = D3DContainer();
+	std::vector<BoundResource> boundResources;
+	unsigned globalsRegister = 0;
 	if (target.version > 9) {
-		opts.shader_model = 40;
-	}
-	else {
-		opts.shader_model = 30;
+		// Fixed registers make the bind points known before fxc runs, so the container needs no D3DReflect
+		spirv_cross::ShaderResources resources = compiler->get_shader_resources();
+		for (auto& resource : resources.sampled_images) boundResources.push_back({ resource, TextureRegister, true });
+		for (auto& resource : resources.separate_images) boundResources.push_back({ resource, TextureRegister, false });
+		for (auto& resource : resources.separate_samplers) boundResources.push_back({ resource, SamplerRegister, false });
+		for (auto& resource : resources.storage_images) boundResources.push_back({ resource, UavRegister, false });
+		for (auto& resource : resources.storage_buffers) {
+			// SPIRV-Cross declares read only storage buffers as ByteAddressBuffer in a texture register
+			bool readOnly = compiler->get_buffer_block_flags(resource.id).get(spv::DecorationNonWritable);
+			boundResources.push_back({ resource, readOnly ? TextureRegister : UavRegister, false });
+		}
+		for (auto& resource : resources.uniform_buffers) boundResources.push_back({ resource, BufferRegister, false });
+
+		auto arraySize = [&](const spirv_cross::Resource& resource) {
+			unsigned count = 1;
+			for (auto length : compiler->get_type(resource.type_id).array) count *= std::max(length, 1u);
+			return count;
+		};
+		RegisterSpace spaces[4];
+		for (auto& bound : boundResources) {
+			if (!compiler->has_decoration(bound.resource.id, spv::DecorationBinding)) continue;
+			unsigned binding = compiler->get_decoration(bound.resource.id, spv::DecorationBinding);
+			spaces[bound.registerClass].reserve(binding, arraySize(bound.resource));
+			if (bound.combined) spaces[SamplerRegister].reserve(binding, arraySize(bound.resource));
+		}
+
+		bool looseUniforms = false;
+		for (auto& inst : instructions) {
+			if (inst.opcode == spv::OpVariable && inst.operands[2] == spv::StorageClassUniformConstant && !isOpaque(compiler->get_type_from_variable(inst.operands[1]))) {
+				looseUniforms = true;
+			}
+		}
+		if (looseUniforms) {
+			// fxc puts $Globals in the first free constant buffer register
+			while (!spaces[BufferRegister].isFree(globalsRegister, 1)) ++globalsRegister;
+			spaces[BufferRegister].reserve(globalsRegister, 1);
+		}
+
+		for (auto& bound : boundResources) {
+			if (compiler->has_decoration(bound.resource.id, spv::DecorationBinding)) continue;
+			unsigned count = arraySize(bound.resource);
+			unsigned binding = 0;
+			while (!spaces[bound.registerClass].isFree(binding, count) || (bound.combined && !spaces[SamplerRegister].isFree(binding, count))) ++binding;
+			compiler->set_decoration(bound.resource.id, spv::DecorationBinding, binding);
+			spaces[bound.registerClass].reserve(binding, count);
+			if (bound.combined) spaces[SamplerRegister].reserve(binding, count);
+		}
 	}
-	compiler->set_hlsl_options(opts);
 
 	std::string hlsl = compiler->compile();
 	if (output) {
@@ -50,6 +188,81 @@ void HlslTranslator2::outputCode(const Target& target, const char* sourcefilenam
 		out.close();
 	}
 
+	// Loose uniforms end up in the $Globals constant buffer in declaration order, Direct3D 9 gets no layout
+	uniformBlocks.clear();
+	UniformLayoutBlock globals;
+	globals.name = "$Globals";
+	unsigned offset = 0;
+	for (unsigned i = 0; i < instructions.size(); ++i) {
+		Instruction& inst = instructions[i];
+		if (inst.opcode != spv::OpVariable || inst.operands[2] != spv::StorageClassUniformConstant) {
+			continue;
+		}
+		const spirv_cross::SPIRType& type = compiler->get_type_from_variable(inst.operands[1]);
+		if (isOpaque(type)) {
+			continue;
+		}
+		UniformLayoutMember member;
+		member.name = compiler->get_name(inst.operands[1]);
+		bool startsRegister;
+		layoutHlslType(compiler.get(), type, member, startsRegister);
+		if (startsRegister || (offset % 16) + member.size > 16) {
+			offset = alignRegister(offset);
+		}
+		member.offset = offset;
+		offset += member.size;
+		globals.members.push_back(member);
+
+		if (target.version > 9) {
+			D3DConstant constant;
+			constant.name = member.name;
+			constant.offset = member.offset;
+			constant.size = member.size;
+			// SPIRV-Cross declares a matrix with n columns as floatnxm, which D3D reports as n rows
+			if (type.basetype != spirv_cross::SPIRType::Struct) {
+				constant.rows = type.columns;
+				constant.columns = type.vecsize;
+			}
+			container.constants.push_back(constant);
+		}
+	}
+	if (target.version > 9 && globals.members.size() > 0) {
+		globals.size = alignRegister(offset);
+		uniformBlocks.push_back(globals);
+	}
+
+	if (target.version > 9) {
+		// Names are read after compiling because SPIRV-Cross renames identifiers HLSL reserves
+		std::vector<std::pair<RegisterClass, D3DResource>> table;
+		for (auto& bound : boundResources) {
+			D3DResource resource;
+			// Constant buffers are declared with the name of their block
+			if (bound.registerClass == BufferRegister) resource.name = compiler->get_name(bound.resource.base_type_id);
+			if (resource.name.empty()) resource.name = compiler->get_name(bound.resource.id);
+			if (resource.name.empty()) resource.name = bound.resource.name;
+			resource.bindPoint = compiler->get_decoration(bound.resource.id, spv::DecorationBinding);
+			table.push_back(std::make_pair(bound.registerClass, resource));
+			if (bound.combined) {
+				D3DResource sampler = resource;
+				sampler.name = "_" + resource.name + "_sampler";
+				table.push_back(std::make_pair(SamplerRegister, sampler));
+			}
+		}
+		if (globals.members.size() > 0) {
+			D3DResource buffer;
+			buffer.name = globals.name;
+			buffer.bindPoint = globalsRegister;
+			table.push_back(std::make_pair(BufferRegister, buffer));
+		}
+		std::stable_sort(table.begin(), table.end(), [](const std::pair<RegisterClass, D3DResource>& a, const std::pair<RegisterClass, D3DResource>& b) {
+			if (a.first != b.first) return a.first < b.first;
+			return a.second.bindPoint < b.second.bindPoint;
+		});
+		for (auto& entry : table) {
+			container.resources.push_back(entry.second);
+		}
+	}
+
 	if (stage == StageVertex) {
 		std::vector<std::string> inputs;
 		auto variables = compiler->get_shader_resources().stage_inputs;
@@ -73,4 +286,5 @@ void HlslTranslator2::outputCode(const Target& target, const char* sourcefilenam
 			attributes[inputs[i]] = attributeIndex++;
 		}
 	}
+	container.attributes = attributes;
 }
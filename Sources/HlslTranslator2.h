@@ -1,11 +1,21 @@
 #pragma once
 
+#include "CrossIR.h"
+#include "D3DContainer.h"
 #include "Translator.h"
+#include "UniformLayout.h"
 
 namespace krafix {
 	class HlslTranslator2 : public Translator {
 	public:
 		HlslTranslator2(std::vector<unsigned>& spirv, ShaderStage stage) : Translator(spirv, stage) {}
 		void outputCode(const Target& target, const char* sourcefilename, const char* filename, char* output, std::map<std::string, int>& attributes) override;
+		std::vector<UniformLayoutBlock> uniformBlocks;
+		// Inferred from the SPIR-V, the D3D compilers build for exactly this model
+		int shaderModel = 0;
+		// Header of the D3D bytecode file, filled from the SPIR-V reflection
+		D3DContainer container;
+		// Owned by the driver, the module is parsed for this translator alone without one
+		CrossIRCache* crossIR = nullptr;
 	};
 }
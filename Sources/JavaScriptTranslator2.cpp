@@ -2,6 +2,7 @@
 #ifdef SPIRV_JS
 #include "../SPIRV-Cross/spirv_js.hpp"
 #include <fstream>
+#include <memory>
 #endif
 
 using namespace krafix;
@@ -24,7 +25,7 @@ void JavaScriptTranslator2::outputCode(const Target& target, const char* sourcef
 	}
 
 #ifdef SPIRV_JS
-	spirv_cross::CompilerJS* compiler = new spirv_cross::CompilerJS(spirv);
+	std::unique_ptr<spirv_cross::CompilerJS> compiler(new spirv_cross::CompilerJS(spirv));
 
 	compiler->set_entry_point("main");
 	spirv_cross::CompilerJS::Options opts = compiler->get_options();
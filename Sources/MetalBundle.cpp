@@ -0,0 +1,301 @@
+#include "MetalBundle.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <set>
+
+using namespace krafix;
+
+namespace {
+	// A top level declaration with the comments in front of it
+	struct Chunk {
+		std::string text;
+		std::string name;
+		bool header = false;
+		bool preprocessor = false;
+	};
+
+	struct Unit {
+		std::vector<Chunk> chunks;
+		std::string suffix;
+	};
+
+	bool isIdentifierChar(char c) {
+		return isalnum((unsigned char)c) || c == '_';
+	}
+
+	std::string trim(const std::string& text) {
+		size_t start = text.find_first_not_of(" \t\r\n");
+		if (start == std::string::npos) return "";
+		size_t end = text.find_last_not_of(" \t\r\n");
+		return text.substr(start, end - start + 1);
+	}
+
+	bool startsWith(const std::string& text, const std::string& prefix) {
+		return text.compare(0, prefix.size(), prefix) == 0;
+	}
+
+	std::vector<std::string> tokenize(const std::string& text) {
+		std::vector<std::string> tokens;
+		for (size_t i = 0; i < text.size();) {
+			if (isIdentifierChar(text[i])) {
+				size_t start = i;
+				while (i < text.size() && isIdentifierChar(text[i])) ++i;
+				tokens.push_back(text.substr(start, i - start));
+			}
+			else if (isspace((unsigned char)text[i])) {
+				++i;
+			}
+			else {
+				tokens.push_back(std::string(1, text[i++]));
+			}
+		}
+		return tokens;
+	}
+
+	// The struct, function or variable a declaration defines
+	std::string declaredName(const std::string& declaration) {
+		std::vector<std::string> tokens = tokenize(declaration.substr(0, declaration.find_first_of("{=")));
+		for (size_t i = 0; i + 1 < tokens.size(); ++i) {
+			if (tokens[i] == "(") break;
+			if (tokens[i] == "struct" || tokens[i] == "union") return tokens[i + 1];
+		}
+		for (size_t i = 1; i < tokens.size(); ++i) {
+			if (tokens[i] != "(") continue;
+			if (tokens[i - 1] != "__attribute__") return tokens[i - 1];
+			for (int depth = 0; i < tokens.size(); ++i) {
+				if (tokens[i] == "(") ++depth;
+				else if (tokens[i] == ")" && --depth == 0) break;
+			}
+		}
+		std::string name;
+		for (auto& token : tokens) {
+			if (token == "[" || token == ";") break;
+			if (isIdentifierChar(token[0]) && !isdigit((unsigned char)token[0])) name = token;
+		}
+		return name;
+	}
+
+	void addChunk(Unit& unit, const std::string& text, bool preprocessor) {
+		Chunk chunk;
+		chunk.text = trim(text);
+		if (chunk.text.empty()) return;
+		std::string code = preprocessor ? chunk.text.substr(chunk.text.find('#')) : chunk.text;
+		if (preprocessor) {
+			chunk.preprocessor = true;
+			chunk.header = startsWith(code, "#include") || startsWith(code, "#pragma");
+			// Keeps #ifndef, #define and #endif runs together
+			if (!chunk.header && !unit.chunks.empty() && unit.chunks.back().preprocessor && !unit.chunks.back().header) {
+				unit.chunks.back().text += "\n" + chunk.text;
+				return;
+			}
+		}
+		else {
+			size_t start = 0;
+			// Skips the comments in front of the declaration
+			while (start < code.size()) {
+				start = code.find_first_not_of(" \t\r\n", start);
+				if (start == std::string::npos) break;
+				if (code.compare(start, 2, "//") == 0) start = code.find('\n', start);
+				else if (code.compare(start, 2, "/*") == 0) {
+					start = code.find("*/", start);
+					if (start != std::string::npos) start += 2;
+				}
+				else break;
+			}
+			code = start == std::string::npos ? "" : code.substr(start);
+			chunk.header = startsWith(code, "using namespace");
+			if (!chunk.header) chunk.name = declaredName(code);
+			if (unit.suffix.empty() && (startsWith(code, "vertex ") || startsWith(code, "fragment ") || startsWith(code, "kernel "))) {
+				unit.suffix = chunk.name;
+				if (unit.suffix.size() > 5 && unit.suffix.compare(unit.suffix.size() - 5, 5, "_main") == 0) {
+					unit.suffix = unit.suffix.substr(0, unit.suffix.size() - 5);
+				}
+			}
+		}
+		unit.chunks.push_back(chunk);
+	}
+
+	Unit parse(const std::string& source) {
+		Unit unit;
+		std::string pending;
+		std::string current;
+		int depth = 0;
+		int parentheses = 0;
+		size_t i = 0;
+		auto finish = [&]() {
+			addChunk(unit, pending + current, false);
+			pending.clear();
+			current.clear();
+		};
+		while (i < source.size()) {
+			char c = source[i];
+			std::string& target = current.empty() ? pending : current;
+			if (source.compare(i, 2, "//") == 0 || source.compare(i, 2, "/*") == 0) {
+				size_t end = source[i + 1] == '/' ? source.find('\n', i) : source.find("*/", i);
+				end = end == std::string::npos ? source.size() : end + (source[i + 1] == '/' ? 0 : 2);
+				target += source.substr(i, end - i);
+				i = end;
+			}
+			else if (c == '"') {
+				size_t end = i + 1;
+				while (end < source.size() && source[end] != '"') end += source[end] == '\\' ? 2 : 1;
+				end = std::min(end + 1, source.size());
+				current += source.substr(i, end - i);
+				i = end;
+			}
+			else if (c == '#' && depth == 0 && current.empty()) {
+				size_t end = i;
+				while (end < source.size() && source[end] != '\n') end += source[end] == '\\' ? 2 : 1;
+				end = std::min(end, source.size());
+				addChunk(unit, pending + source.substr(i, end - i), true);
+				pending.clear();
+				i = end;
+			}
+			else if (current.empty() && isspace((unsigned char)c)) {
+				pending += c;
+				++i;
+			}
+			else {
+				current += c;
+				++i;
+				// Initializers like spvUnsafeArray<float, 3>({ ... }) close braces inside parentheses
+				if (c == '(') {
+					++parentheses;
+				}
+				else if (c == ')') {
+					--parentheses;
+				}
+				else if (c == '{') {
+					++depth;
+				}
+				else if (c == '}' && --depth == 0 && parentheses == 0) {
+					size_t end = source.find_first_not_of(" \t", i);
+					if (end != std::string::npos && source[end] == ';') {
+						current += source.substr(i, end + 1 - i);
+						i = end + 1;
+					}
+					finish();
+				}
+				else if (c == ';' && depth == 0 && parentheses == 0) {
+					finish();
+				}
+			}
+		}
+		finish();
+		return unit;
+	}
+
+	std::string renameIdentifier(const std::string& text, const std::string& from, const std::string& to) {
+		std::string result;
+		for (size_t i = 0; i < text.size();) {
+			if (!isIdentifierChar(text[i])) {
+				result += text[i++];
+				continue;
+			}
+			size_t start = i;
+			while (i < text.size() && isIdentifierChar(text[i])) ++i;
+			std::string identifier = text.substr(start, i - start);
+			bool member = start > 0 && (text[start - 1] == '.' || (start > 1 && text[start - 2] == '-' && text[start - 1] == '>'));
+			result += identifier == from && !member ? to : identifier;
+		}
+		return result;
+	}
+
+	// Everything a shader declares under a name, overloads included
+	std::map<std::string, std::string> declarations(const Unit& unit) {
+		std::map<std::string, std::string> variants;
+		for (auto& chunk : unit.chunks) {
+			if (!chunk.name.empty()) variants[chunk.name] += chunk.text + "\n";
+		}
+		return variants;
+	}
+}
+
+std::string krafix::bundleMetal(const std::vector<std::string>& sources) {
+	std::vector<Unit> units;
+	std::set<std::string> suffixes;
+	for (auto& source : sources) {
+		units.push_back(parse(source));
+		std::string& suffix = units.back().suffix;
+		if (suffix.empty()) suffix = "shader";
+		std::string unique = suffix;
+		for (int i = 1; !suffixes.insert(unique).second; ++i) unique = suffix + std::to_string(i);
+		suffix = unique;
+	}
+
+	// Renaming a struct changes the functions using it, which can then conflict as well
+	for (bool renamed = true; renamed;) {
+		renamed = false;
+		std::map<std::string, std::string> canonical;
+		for (auto& unit : units) {
+			std::vector<std::string> conflicts;
+			for (auto& variant : declarations(unit)) {
+				auto found = canonical.find(variant.first);
+				if (found == canonical.end()) canonical[variant.first] = variant.second;
+				else if (found->second != variant.second) conflicts.push_back(variant.first);
+			}
+			for (auto& name : conflicts) {
+				std::string replacement = name + "_" + unit.suffix;
+				for (auto& chunk : unit.chunks) {
+					chunk.text = renameIdentifier(chunk.text, name, replacement);
+					if (chunk.name == name) chunk.name = replacement;
+				}
+				renamed = true;
+			}
+		}
+	}
+
+	std::string headers;
+	std::string body;
+	std::set<std::string> written;
+	for (auto& unit : units) {
+		for (auto& chunk : unit.chunks) {
+			// Only declarations and directives are known to mean the same wherever they appear
+			bool shared = chunk.header || chunk.preprocessor || !chunk.name.empty();
+			if (shared && !written.insert(chunk.text).second) continue;
+			if (chunk.header) headers += chunk.text + "\n";
+			else body += "\n" + chunk.text + "\n";
+		}
+	}
+	return headers + body;
+}
+
+int krafix::bundleMetalFiles(const std::string& output, const std::vector<std::string>& inputs, int parts) {
+	int errors = 0;
+	std::vector<std::string> sources;
+	for (auto& input : inputs) {
+		std::ifstream in(input.c_str(), std::ios::binary);
+		if (!in) {
+			std::cerr << "Error: unable to open input file: " << input << std::endl;
+			++errors;
+			continue;
+		}
+		sources.push_back(std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()));
+	}
+	if (errors > 0) return errors;
+
+	parts = std::max(1, std::min(parts, (int)sources.size()));
+	size_t split = output.find_last_of('.');
+	if (split != std::string::npos && output.find_first_of("/\\", split) != std::string::npos) split = std::string::npos;
+	for (int part = 0; part < parts; ++part) {
+		std::vector<std::string> partSources(sources.begin() + sources.size() * part / parts, sources.begin() + sources.size() * (part + 1) / parts);
+		std::string filename = output;
+		if (parts > 1) {
+			filename = split == std::string::npos ? output + "-" + std::to_string(part) : output.substr(0, split) + "-" + std::to_string(part) + output.substr(split);
+		}
+		std::ofstream out(filename.c_str(), std::ios::binary | std::ios::out);
+		out << bundleMetal(partSources);
+		if (!out) {
+			std::cerr << "Error: unable to write " << filename << std::endl;
+			++errors;
+			continue;
+		}
+		std::cerr << "#file:" << filename << std::endl;
+	}
+	return errors;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace krafix {
+	// Merges Metal sources written by MetalTranslator2 into one translation unit. Includes, pragmas and identical
+	// structs, helper functions and constants are written once. Declarations of the same name that differ between
+	// shaders get the shader's entry point name as a suffix.
+	std::string bundleMetal(const std::vector<std::string>& sources);
+
+	// Bundles the input files into parts translation units, output or output-0.metal, output-1.metal... for more
+	// than one part. Returns the number of errors.
+	int bundleMetalFiles(const std::string& output, const std::vector<std::string>& inputs, int parts);
+}
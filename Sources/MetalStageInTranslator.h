@@ -5,7 +5,6 @@
 
 #include <vector>
 #include <map>
-#include <unordered_map>
 #include <string>
 #include <sstream>
 #include <cstdint>
@@ -37,7 +36,7 @@ namespace krafix {
 
 	/** The rendering context in which a shader conversion occurs. */
 	struct MetalStageInTranslatorRenderContext {
-		std::unordered_map<unsigned, MetalVertexAttribute> vertexAttributesByLocation;
+		std::map<unsigned, MetalVertexAttribute> vertexAttributesByLocation;
 		signed vertexAttributeStageInBinding;
 		bool shouldFlipVertexY;
 		bool shouldFlipFragmentY;
@@ -86,7 +85,7 @@ namespace krafix {
 		bool paramComma(std::ostream* out, bool needsComma);
 
 		MetalStageInTranslatorRenderContext* _pRenderContext;
-		std::unordered_map<unsigned, MetalVertexInStruct> _vertexInStructs;
+		std::map<unsigned, MetalVertexInStruct> _vertexInStructs;
 		unsigned _nextMTLBufferIndex;
 		unsigned _nextMTLTextureIndex;
 		unsigned _nextMTLSamplerIndex;
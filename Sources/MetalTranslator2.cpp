@@ -1,6 +1,9 @@
 #include "MetalTranslator2.h"
+#include "CrossIR.h"
 #include "../SPIRV-Cross/spirv_msl.hpp"
 #include <fstream>
+#include <memory>
+#include <set>
 
 using namespace krafix;
 
@@ -55,7 +58,7 @@ void MetalTranslator2::outputCode(const Target& target, const char* sourcefilena
 		}
 	}
 
-	spirv_cross::CompilerMSL* compiler = new spirv_cross::CompilerMSL(spirv);
+	std::unique_ptr<spirv_cross::CompilerMSL> compiler(new spirv_cross::CompilerMSL(*parseCrossIR(spirv, crossIR)));
 
 	std::string name = extractFilename(sourcefilename);
 	name = name.substr(0, name.find_last_of("."));
@@ -79,6 +82,10 @@ void MetalTranslator2::outputCode(const Target& target, const char* sourcefilena
 		spirv_cross::CompilerMSL::Options opts = compiler->get_msl_options();
 		opts.platform = target.system == iOS ? spirv_cross::CompilerMSL::Options::iOS : spirv_cross::CompilerMSL::Options::macOS;
 		opts.enable_decoration_binding = true;
+		if (!descriptors.empty()) {
+			opts.set_msl_version(2, 0);
+			opts.argument_buffers = true;
+		}
 		compiler->set_msl_options(opts);
 	}
 
@@ -87,6 +94,46 @@ void MetalTranslator2::outputCode(const Target& target, const char* sourcefilena
 	mslBinding.msl_buffer = stage == StageVertex ? 1 : 0;
 	compiler->add_msl_resource_binding(mslBinding);
 
+	if (!descriptors.empty()) {
+		// The uniforms change with every draw and stay a discrete buffer
+		compiler->add_discrete_descriptor_set(0);
+
+		spirv_cross::ShaderResources resources = compiler->get_shader_resources();
+		std::vector<spirv_cross::Resource> opaque(resources.sampled_images.begin(), resources.sampled_images.end());
+		opaque.insert(opaque.end(), resources.separate_images.begin(), resources.separate_images.end());
+		opaque.insert(opaque.end(), resources.separate_samplers.begin(), resources.separate_samplers.end());
+		opaque.insert(opaque.end(), resources.storage_images.begin(), resources.storage_images.end());
+
+		std::set<uint32_t> frequencies;
+		for (auto& resource : opaque) {
+			const DescriptorBinding* descriptor = findDescriptor(descriptors, compiler->get_name(resource.id), stage);
+			if (descriptor == nullptr) continue;
+			compiler->set_decoration(resource.id, spv::DecorationDescriptorSet, argumentBufferSet(descriptor->set));
+			compiler->set_decoration(resource.id, spv::DecorationBinding, descriptor->binding);
+
+			uint32_t id = 0, samplerId = 0;
+			findArgumentIds(descriptors, *descriptor, id, samplerId);
+			spirv_cross::MSLResourceBinding binding;
+			binding.stage = convert(stage);
+			binding.desc_set = argumentBufferSet(descriptor->set);
+			binding.binding = descriptor->binding;
+			binding.msl_texture = id;
+			binding.msl_sampler = samplerId;
+			binding.msl_buffer = id;
+			compiler->add_msl_resource_binding(binding);
+			frequencies.insert(descriptor->set);
+		}
+
+		for (uint32_t frequency : frequencies) {
+			spirv_cross::MSLResourceBinding buffer;
+			buffer.stage = convert(stage);
+			buffer.desc_set = argumentBufferSet(frequency);
+			buffer.binding = spirv_cross::kArgumentBufferBinding;
+			buffer.msl_buffer = argumentBufferIndex(frequency);
+			compiler->add_msl_resource_binding(buffer);
+		}
+	}
+
 	std::string metal = compiler->compile();
 	if (output) {
 		strcpy(output, metal.c_str());
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "CrossIR.h"
+#include "DescriptorPlan.h"
 #include "Translator.h"
 
 namespace krafix {
@@ -7,5 +9,9 @@ namespace krafix {
 	public:
 		MetalTranslator2(std::vector<unsigned>& spirv, ShaderStage stage) : Translator(spirv, stage) {}
 		void outputCode(const Target& target, const char* sourcefilename, const char* filename, char* output, std::map<std::string, int>& attributes) override;
+		// Puts textures and samplers in one argument buffer per update frequency when not empty
+		std::vector<DescriptorBinding> descriptors;
+		// Owned by the driver, the module is parsed for this translator alone without one
+		CrossIRCache* crossIR = nullptr;
 	};
 }
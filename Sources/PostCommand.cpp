@@ -0,0 +1,95 @@
+#include "PostCommand.h"
+
+#include <cstdio>
+#include <iostream>
+
+using namespace krafix;
+
+namespace {
+	bool replaceAll(std::string& text, const std::string& placeholder, const std::string& value) {
+		bool found = false;
+		for (size_t position = text.find(placeholder); position != std::string::npos; position = text.find(placeholder, position + value.size())) {
+			text.replace(position, placeholder.size(), value);
+			found = true;
+		}
+		return found;
+	}
+}
+
+PostCommandPool::PostCommandPool(const std::vector<std::string>& commands, unsigned jobs, CommandRunner run) : commands(commands), run(run) {
+	if (jobs == 0) jobs = 1;
+	for (unsigned i = 0; i < jobs; ++i) {
+		workers.push_back(std::thread(&PostCommandPool::work, this));
+	}
+}
+
+PostCommandPool::~PostCommandPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	changed.notify_all();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+void PostCommandPool::add(const std::string& filename) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(filename);
+	}
+	changed.notify_all();
+}
+
+int PostCommandPool::finish() {
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait(lock, [this]() { return queue.empty() && running == 0; });
+	int result = failures;
+	failures = 0;
+	return result;
+}
+
+void PostCommandPool::work() {
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		changed.wait(lock, [this]() { return stopping || !queue.empty(); });
+		if (queue.empty()) return;
+		std::string filename = queue.front();
+		queue.pop_front();
+		++running;
+		lock.unlock();
+		bool success = runChain(filename);
+		lock.lock();
+		--running;
+		if (!success) ++failures;
+		changed.notify_all();
+	}
+}
+
+bool PostCommandPool::runChain(const std::string& filename) {
+	std::string result = filename + ".post";
+	for (auto& command : commands) {
+		std::string line = command;
+		bool input = replaceAll(line, "{in}", "\"" + filename + "\"");
+		bool output = replaceAll(line, "{out}", "\"" + result + "\"");
+		if (!input && !output) line += " \"" + filename + "\"";
+
+		if (output) remove(result.c_str());
+		int code = run(line.c_str());
+		if (code != 0) {
+			std::lock_guard<std::mutex> lock(mutex);
+			std::cerr << "Error: " << line << " failed with exit code " << code << std::endl;
+			return false;
+		}
+		if (output) {
+			remove(filename.c_str());
+			if (rename(result.c_str(), filename.c_str()) != 0) {
+				std::lock_guard<std::mutex> lock(mutex);
+				std::cerr << "Error: " << line << " did not write " << result << std::endl;
+				return false;
+			}
+		}
+	}
+	return true;
+}
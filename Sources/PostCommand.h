@@ -0,0 +1,39 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace krafix {
+	// Runs a shell command and returns its exit code
+	typedef int (*CommandRunner)(const char* command);
+
+	// Runs a chain of external commands on every output file while krafix goes on translating the next one. In a
+	// command {in} stands for the output file and {out} for a file the tool writes, which then replaces the output.
+	// Commands without either get the output file appended. At most jobs chains run at the same time.
+	class PostCommandPool {
+	public:
+		PostCommandPool(const std::vector<std::string>& commands, unsigned jobs, CommandRunner run);
+		~PostCommandPool();
+		void add(const std::string& filename);
+		// Waits for all added files, returns the number of failed chains
+		int finish();
+
+	private:
+		void work();
+		bool runChain(const std::string& filename);
+
+		std::vector<std::string> commands;
+		CommandRunner run;
+		std::vector<std::thread> workers;
+		std::deque<std::string> queue;
+		std::mutex mutex;
+		std::condition_variable changed;
+		unsigned running = 0;
+		int failures = 0;
+		bool stopping = false;
+	};
+}
@@ -0,0 +1,520 @@
+#include "PrecisionAnalysis.h"
+#include "SpirVModule.h"
+
+#include <SPIRV/spirv.hpp>
+#include <SPIRV/GLSL.std.450.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <set>
+
+using namespace krafix;
+
+namespace {
+	using namespace spv;
+
+	// Within [-2, 2] mediump's 10 bit mantissa keeps the error below 2^-11, enough for 8 bit colours, unit vectors and
+	// texture coordinates of textures up to 1024 texels
+	const double mediumpMagnitude = 2.0;
+
+	// Scaling by more than this before fract, floor or mod moves mediump's rounding error into the bits they keep
+	const double amplifyingFactor = 16.0;
+
+	// After this many passes over a function, values that still grow (loop accumulators) become unbounded
+	const int widenAfterPasses = 8;
+
+	const double infinity = std::numeric_limits<double>::infinity();
+
+	struct Range {
+		double low;
+		double high;
+
+		bool bounded() const { return low > -infinity && high < infinity; }
+		bool operator==(const Range& other) const { return low == other.low && high == other.high; }
+		bool operator!=(const Range& other) const { return !(*this == other); }
+	};
+
+	const Range unbounded = { -infinity, infinity };
+
+	Range hull(const Range& a, const Range& b) {
+		return { std::min(a.low, b.low), std::max(a.high, b.high) };
+	}
+
+	Range product(const Range& a, const Range& b) {
+		if (!a.bounded() || !b.bounded()) return unbounded;
+		double values[] = { a.low * b.low, a.low * b.high, a.high * b.low, a.high * b.high };
+		return { *std::min_element(values, values + 4), *std::max_element(values, values + 4) };
+	}
+
+	Range scale(const Range& a, double factor) {
+		if (!a.bounded()) return unbounded;
+		return { a.low * factor, a.high * factor };
+	}
+
+	double magnitude(const Range& a) {
+		return std::max(std::fabs(a.low), std::fabs(a.high));
+	}
+
+	class Analysis {
+	public:
+		Analysis(SpirVModule& module) : module(module) {
+			for (auto& instruction : module.instructions) {
+				uint32_t op = SpirVModule::opcode(instruction);
+				switch (op) {
+				case OpExtInstImport:
+					if (strcmp((const char*)&instruction[2], "GLSL.std.450") == 0) glslExtension = instruction[1];
+					break;
+				case OpTypeFloat:
+					if (instruction[2] == 32) {
+						floatTypes.insert(instruction[1]);
+						components[instruction[1]] = 1;
+					}
+					break;
+				case OpTypeVector:
+				case OpTypeMatrix:
+					if (floatTypes.count(instruction[2]) != 0) {
+						floatTypes.insert(instruction[1]);
+						components[instruction[1]] = instruction[3];
+					}
+					break;
+				case OpTypePointer:
+					pointees[instruction[1]] = instruction[3];
+					break;
+				case OpConstant:
+					if (floatTypes.count(instruction[1]) != 0) {
+						float value;
+						memcpy(&value, &instruction[3], sizeof(value));
+						ranges[instruction[2]] = { value, value };
+					}
+					break;
+				case OpConstantComposite:
+					if (floatTypes.count(instruction[1]) != 0) {
+						Range range = { infinity, -infinity };
+						for (size_t i = 3; i < instruction.size(); ++i) {
+							auto constituent = ranges.find(instruction[i]);
+							range = constituent == ranges.end() ? unbounded : hull(range, constituent->second);
+						}
+						ranges[instruction[2]] = range;
+					}
+					break;
+				case OpVariable:
+					if (instruction[3] == StorageClassFunction && floatTypes.count(pointees[instruction[1]]) != 0) {
+						variables.insert(instruction[2]);
+						if (instruction.size() > 4) initializers[instruction[2]] = instruction[4];
+					}
+					if (instruction[3] == StorageClassOutput) outputs.insert(instruction[2]);
+					break;
+				case OpAccessChain:
+				case OpInBoundsAccessChain:
+					if (outputs.count(instruction[3]) != 0) outputs.insert(instruction[2]);
+					break;
+				}
+				if (op >= OpTypeVoid && op <= OpTypeForwardPointer) continue;
+				if (instruction.size() > 2 && SpirVModule::hasResult(op)) resultTypes[instruction[2]] = instruction[1];
+			}
+			findEscapingVariables();
+		}
+
+		void run() {
+			for (auto& variable : initializers) {
+				auto initializer = ranges.find(variable.second);
+				if (initializer != ranges.end()) ranges[variable.first] = initializer->second;
+			}
+			for (int pass = 0;; ++pass) {
+				std::set<uint32_t> changed;
+				for (auto& instruction : module.instructions) {
+					step(instruction, changed);
+				}
+				if (changed.empty()) break;
+				if (pass >= widenAfterPasses) {
+					for (uint32_t id : changed) ranges[id] = unbounded;
+				}
+			}
+			findAmplifiedInputs();
+		}
+
+		// Function local results and variables that provably fit mediump and only feed other relaxed values, bounded
+		// outputs and texture coordinates
+		std::vector<uint32_t> relaxable() const {
+			std::vector<uint32_t> candidates;
+			std::set<uint32_t> relaxed;
+			std::map<uint32_t, std::vector<std::pair<const std::vector<uint32_t>*, size_t>>> uses;
+			bool inFunction = false;
+			for (auto& instruction : module.instructions) {
+				uint32_t op = SpirVModule::opcode(instruction);
+				if (op == OpFunction) inFunction = true;
+				if (!inFunction) continue;
+				// Loads and stores through an access chain use the variable
+				if (op != OpAccessChain && op != OpInBoundsAccessChain) {
+					for (size_t word : SpirVModule::idOperands(instruction)) {
+						uses[baseVariable(instruction[word])].push_back(std::make_pair(&instruction, word));
+					}
+				}
+				if (instruction.size() < 3) continue;
+				uint32_t id = 0;
+				if (op == OpVariable) {
+					if (variables.count(instruction[2]) != 0) id = instruction[2];
+				}
+				else if (SpirVModule::hasResult(op) && op != OpFunction && op != OpFunctionParameter && op != OpFunctionCall && floatTypes.count(instruction[1]) != 0) {
+					id = instruction[2];
+				}
+				if (id == 0 || amplified.count(id) != 0) continue;
+				auto range = ranges.find(id);
+				if (range != ranges.end() && range->second.bounded() && magnitude(range->second) <= mediumpMagnitude) {
+					candidates.push_back(id);
+					relaxed.insert(id);
+				}
+			}
+
+			for (bool removed = true; removed;) {
+				removed = false;
+				for (uint32_t id : candidates) {
+					if (relaxed.count(id) == 0) continue;
+					auto found = uses.find(id);
+					if (found == uses.end()) continue;
+					for (auto& use : found->second) {
+						if (!relaxedUse(*use.first, use.second, relaxed)) {
+							relaxed.erase(id);
+							removed = true;
+							break;
+						}
+					}
+				}
+			}
+
+			std::vector<uint32_t> ids;
+			for (uint32_t id : candidates) {
+				if (relaxed.count(id) != 0) ids.push_back(id);
+			}
+			return ids;
+		}
+
+	private:
+		bool relaxedUse(const std::vector<uint32_t>& instruction, size_t word, const std::set<uint32_t>& relaxed) const {
+			uint32_t op = SpirVModule::opcode(instruction);
+			if (op == OpStore) {
+				uint32_t target = baseVariable(instruction[1]);
+				return word == 1 || relaxed.count(target) != 0 || outputs.count(target) != 0;
+			}
+			if (op >= OpImageSampleImplicitLod && op <= OpImageSampleProjDrefExplicitLod && word == 4) return true;
+			uint32_t result = SpirVModule::resultId(instruction);
+			return result != 0 && relaxed.count(result) != 0;
+		}
+
+		// Fract, floor and mod keep the low bits of their operand. When the operand is large or was scaled up on the way,
+		// like in fract(sin(x) * 43758.5453), neither the operation nor the values it was computed from may be relaxed.
+		void findAmplifiedInputs() {
+			std::map<uint32_t, const std::vector<uint32_t>*> definitions;
+			for (auto& instruction : module.instructions) {
+				uint32_t result = SpirVModule::resultId(instruction);
+				if (result != 0) definitions[result] = &instruction;
+			}
+			for (auto& instruction : module.instructions) {
+				uint32_t op = SpirVModule::opcode(instruction);
+				uint32_t operand = 0;
+				if ((op == OpFMod || op == OpFRem) && instruction.size() > 4) operand = instruction[3];
+				else if (op == OpExtInst && instruction.size() > 5 && instruction[3] == glslExtension
+					&& (instruction[4] == GLSLstd450Fract || instruction[4] == GLSLstd450Floor)) operand = instruction[5];
+				if (operand == 0) continue;
+
+				std::vector<uint32_t> inputs;
+				bool scaled = false;
+				collectInputs(operand, definitions, inputs, scaled);
+				Range range;
+				if (!scaled && rangeOf(operand, range) && range.bounded() && magnitude(range) <= mediumpMagnitude) continue;
+				amplified.insert(instruction[2]);
+				if (scaled) amplified.insert(inputs.begin(), inputs.end());
+			}
+		}
+
+		void collectInputs(uint32_t id, const std::map<uint32_t, const std::vector<uint32_t>*>& definitions, std::vector<uint32_t>& inputs, bool& scaled) const {
+			if (std::find(inputs.begin(), inputs.end(), id) != inputs.end()) return;
+			inputs.push_back(id);
+			auto definition = definitions.find(id);
+			if (definition == definitions.end()) return;
+			const std::vector<uint32_t>& instruction = *definition->second;
+			Range a, b;
+			switch (SpirVModule::opcode(instruction)) {
+			case OpFMul:
+			case OpVectorTimesScalar:
+				if (!rangeOf(instruction[3], a) || !rangeOf(instruction[4], b) || magnitude(a) > amplifyingFactor || magnitude(b) > amplifyingFactor) scaled = true;
+				collectInputs(instruction[3], definitions, inputs, scaled);
+				collectInputs(instruction[4], definitions, inputs, scaled);
+				break;
+			case OpFDiv:
+				if (!rangeOf(instruction[4], b) || !(b.low > 1.0 / amplifyingFactor || b.high < -1.0 / amplifyingFactor)) scaled = true;
+				collectInputs(instruction[3], definitions, inputs, scaled);
+				collectInputs(instruction[4], definitions, inputs, scaled);
+				break;
+			case OpFAdd:
+			case OpFSub:
+			case OpVectorShuffle:
+				collectInputs(instruction[3], definitions, inputs, scaled);
+				collectInputs(instruction[4], definitions, inputs, scaled);
+				break;
+			case OpFNegate:
+			case OpCopyObject:
+			case OpCompositeExtract:
+				collectInputs(instruction[3], definitions, inputs, scaled);
+				break;
+			case OpCompositeConstruct:
+				for (size_t i = 3; i < instruction.size(); ++i) collectInputs(instruction[i], definitions, inputs, scaled);
+				break;
+			case OpLoad:
+				if (variables.count(baseVariable(instruction[3])) != 0) inputs.push_back(baseVariable(instruction[3]));
+				break;
+			}
+		}
+
+		// Variables whose pointer is handed to anything but loads, stores and access chains can change behind our back
+		void findEscapingVariables() {
+			for (auto& instruction : module.instructions) {
+				uint32_t op = SpirVModule::opcode(instruction);
+				if ((op == OpAccessChain || op == OpInBoundsAccessChain) && variables.count(baseVariable(instruction[3])) != 0) {
+					bases[instruction[2]] = baseVariable(instruction[3]);
+				}
+			}
+			for (auto& instruction : module.instructions) {
+				uint32_t op = SpirVModule::opcode(instruction);
+				size_t first;
+				if (op == OpLoad) first = 4;
+				else if (op == OpStore) first = 2;
+				else if (op == OpAccessChain || op == OpInBoundsAccessChain || op == OpVariable || op == OpName || op == OpDecorate) continue;
+				else first = 1;
+				for (size_t i = first; i < instruction.size(); ++i) {
+					uint32_t variable = baseVariable(instruction[i]);
+					if (variables.count(variable) != 0) escaping.insert(variable);
+				}
+			}
+		}
+
+		uint32_t baseVariable(uint32_t pointer) const {
+			auto base = bases.find(pointer);
+			return base == bases.end() ? pointer : base->second;
+		}
+
+		bool rangeOf(uint32_t id, Range& range) const {
+			auto found = ranges.find(id);
+			if (found == ranges.end()) return false;
+			range = found->second;
+			return true;
+		}
+
+		void update(uint32_t id, const Range& range, std::set<uint32_t>& changed) {
+			auto found = ranges.find(id);
+			if (found == ranges.end()) {
+				ranges[id] = range;
+				changed.insert(id);
+			}
+			else {
+				Range joined = hull(found->second, range);
+				if (joined != found->second) {
+					found->second = joined;
+					changed.insert(id);
+				}
+			}
+		}
+
+		uint32_t componentCount(uint32_t id) const {
+			auto type = resultTypes.find(id);
+			if (type == resultTypes.end()) return 4;
+			auto count = components.find(type->second);
+			return count == components.end() ? 4 : count->second;
+		}
+
+		void step(const std::vector<uint32_t>& instruction, std::set<uint32_t>& changed) {
+			uint32_t op = SpirVModule::opcode(instruction);
+			if (op == OpStore) {
+				uint32_t variable = baseVariable(instruction[1]);
+				Range value;
+				if (variables.count(variable) == 0) return;
+				if (escaping.count(variable) != 0 || !rangeOf(instruction[2], value)) value = unbounded;
+				update(variable, value, changed);
+				return;
+			}
+			if (instruction.size() < 3 || floatTypes.count(instruction[1]) == 0) return;
+			uint32_t id = instruction[2];
+			if (op == OpConstant || op == OpConstantComposite) return;
+
+			Range result = unbounded;
+			Range a, b;
+			switch (op) {
+			case OpLoad: {
+				uint32_t variable = baseVariable(instruction[3]);
+				if (variables.count(variable) == 0 || escaping.count(variable) != 0) break;
+				if (!rangeOf(variable, result)) return;
+				break;
+			}
+			case OpFAdd:
+				if (!rangeOf(instruction[3], a) || !rangeOf(instruction[4], b)) return;
+				result = a.bounded() && b.bounded() ? Range{ a.low + b.low, a.high + b.high } : unbounded;
+				break;
+			case OpFSub:
+				if (!rangeOf(instruction[3], a) || !rangeOf(instruction[4], b)) return;
+				result = a.bounded() && b.bounded() ? Range{ a.low - b.high, a.high - b.low } : unbounded;
+				break;
+			case OpFMul:
+			case OpVectorTimesScalar:
+			case OpMatrixTimesScalar:
+				if (!rangeOf(instruction[3], a) || !rangeOf(instruction[4], b)) return;
+				result = product(a, b);
+				break;
+			case OpFDiv:
+				if (!rangeOf(instruction[3], a) || !rangeOf(instruction[4], b)) return;
+				if (b.bounded() && (b.low > 0 || b.high < 0)) result = product(a, { 1.0 / b.high, 1.0 / b.low });
+				break;
+			case OpFNegate:
+				if (!rangeOf(instruction[3], a)) return;
+				result = { -a.high, -a.low };
+				break;
+			case OpDot:
+				if (!rangeOf(instruction[3], a) || !rangeOf(instruction[4], b)) return;
+				result = scale(product(a, b), componentCount(instruction[3]));
+				break;
+			case OpMatrixTimesVector:
+				if (!rangeOf(instruction[3], a) || !rangeOf(instruction[4], b)) return;
+				result = scale(product(a, b), componentCount(instruction[4]));
+				break;
+			case OpVectorTimesMatrix:
+				if (!rangeOf(instruction[3], a) || !rangeOf(instruction[4], b)) return;
+				result = scale(product(a, b), componentCount(instruction[3]));
+				break;
+			case OpMatrixTimesMatrix:
+				if (!rangeOf(instruction[3], a) || !rangeOf(instruction[4], b)) return;
+				result = scale(product(a, b), componentCount(instruction[3]));
+				break;
+			case OpCompositeExtract:
+			case OpCopyObject:
+				if (!rangeOf(instruction[3], result)) return;
+				break;
+			case OpVectorShuffle:
+				if (!rangeOf(instruction[3], a) || !rangeOf(instruction[4], b)) return;
+				result = hull(a, b);
+				break;
+			case OpSelect:
+				if (!rangeOf(instruction[4], a) || !rangeOf(instruction[5], b)) return;
+				result = hull(a, b);
+				break;
+			case OpCompositeConstruct:
+			case OpPhi: {
+				size_t stride = op == OpPhi ? 2 : 1;
+				result = { infinity, -infinity };
+				for (size_t i = 3; i < instruction.size(); i += stride) {
+					if (!rangeOf(instruction[i], a)) {
+						// Phis see their back edge values in a later pass
+						if (op == OpPhi) continue;
+						a = unbounded;
+					}
+					result = hull(result, a);
+				}
+				if (result.low > result.high) return;
+				break;
+			}
+			case OpImageSampleDrefImplicitLod:
+			case OpImageSampleDrefExplicitLod:
+			case OpImageSampleProjDrefImplicitLod:
+			case OpImageSampleProjDrefExplicitLod:
+			case OpImageDrefGather:
+				result = { 0, 1 };
+				break;
+			case OpExtInst:
+				if (instruction[3] != glslExtension) break;
+				if (!extendedInstruction(instruction, result)) return;
+				break;
+			}
+			update(id, result, changed);
+		}
+
+		bool extendedInstruction(const std::vector<uint32_t>& instruction, Range& result) {
+			Range a, b, c;
+			size_t operands = instruction.size() - 5;
+			if (operands > 0 && !rangeOf(instruction[5], a)) return false;
+			if (operands > 1 && !rangeOf(instruction[6], b)) return false;
+			if (operands > 2 && !rangeOf(instruction[7], c)) return false;
+			switch (instruction[4]) {
+			case GLSLstd450Sin:
+			case GLSLstd450Cos:
+			case GLSLstd450Normalize:
+			case GLSLstd450FSign:
+				result = { -1, 1 };
+				break;
+			case GLSLstd450Fract:
+			case GLSLstd450Step:
+			case GLSLstd450SmoothStep:
+				result = { 0, 1 };
+				break;
+			case GLSLstd450FAbs:
+				result = a.low >= 0 ? a : Range{ 0, magnitude(a) };
+				break;
+			case GLSLstd450Floor:
+			case GLSLstd450Ceil:
+			case GLSLstd450Round:
+			case GLSLstd450RoundEven:
+			case GLSLstd450Trunc:
+				result = a.bounded() ? Range{ std::floor(a.low), std::ceil(a.high) } : unbounded;
+				break;
+			case GLSLstd450Sqrt:
+				result = a.bounded() ? Range{ 0, std::sqrt(std::max(a.high, 0.0)) } : unbounded;
+				break;
+			case GLSLstd450FMin:
+			case GLSLstd450NMin:
+				result = { std::min(a.low, b.low), std::min(a.high, b.high) };
+				break;
+			case GLSLstd450FMax:
+			case GLSLstd450NMax:
+				result = { std::max(a.low, b.low), std::max(a.high, b.high) };
+				break;
+			case GLSLstd450FClamp:
+			case GLSLstd450NClamp:
+				result = { std::max(a.low, b.low), std::min(a.high, c.high) };
+				if (result.low > result.high) result = hull(b, c);
+				break;
+			case GLSLstd450FMix:
+				result = c.low >= 0 && c.high <= 1 ? hull(a, b) : unbounded;
+				break;
+			case GLSLstd450Length:
+				result = a.bounded() ? Range{ 0, magnitude(a) * std::sqrt((double)componentCount(instruction[5])) } : unbounded;
+				break;
+			case GLSLstd450Distance:
+				result = a.bounded() && b.bounded() ? Range{ 0, (magnitude(a) + magnitude(b)) * std::sqrt((double)componentCount(instruction[5])) } : unbounded;
+				break;
+			default:
+				result = unbounded;
+				break;
+			}
+			return true;
+		}
+
+		SpirVModule& module;
+		uint32_t glslExtension = 0;
+		std::set<uint32_t> floatTypes;
+		std::map<uint32_t, uint32_t> components;
+		std::map<uint32_t, uint32_t> pointees;
+		std::map<uint32_t, uint32_t> resultTypes;
+		std::set<uint32_t> variables;
+		std::map<uint32_t, uint32_t> initializers;
+		std::map<uint32_t, uint32_t> bases;
+		std::set<uint32_t> escaping;
+		std::set<uint32_t> outputs;
+		std::set<uint32_t> amplified;
+		std::map<uint32_t, Range> ranges;
+	};
+}
+
+unsigned krafix::relaxPrecision(std::vector<uint32_t>& spirv) {
+	SpirVModule module(spirv);
+	Analysis analysis(module);
+	analysis.run();
+
+	unsigned count = 0;
+	for (uint32_t id : analysis.relaxable()) {
+		if (module.hasDecoration(id, DecorationRelaxedPrecision)) continue;
+		module.addAnnotation(SpirVModule::makeInstruction(OpDecorate, { id, DecorationRelaxedPrecision }));
+		++count;
+	}
+	if (count > 0) spirv = module.assemble();
+	return count;
+}
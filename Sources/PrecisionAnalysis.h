@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace krafix {
+	// Tracks the value range of every float computation and decorates the results and function variables that
+	// provably stay within [-2, 2] and only feed other relaxed values, outputs and texture coordinates with
+	// RelaxedPrecision so ESSL output declares them mediump. Inputs, uniforms, texture samples and function parameters
+	// count as unbounded until a clamp, normalize, fract, sin/cos or a similar operation bounds them. Returns the
+	// number of decorated ids.
+	unsigned relaxPrecision(std::vector<uint32_t>& spirv);
+}
@@ -0,0 +1,132 @@
+#include "ResourceUsage.h"
+#include "SpirVModule.h"
+
+#include <SPIRV/spirv.hpp>
+
+#include <algorithm>
+#include <set>
+
+using namespace krafix;
+
+namespace {
+	using namespace spv;
+
+	struct Resource {
+		uint32_t id;
+		std::string name;
+	};
+
+	std::vector<Resource> unusedResources(const SpirVModule& module, std::set<uint32_t>& reachable) {
+		std::map<uint32_t, std::string> names = module.names();
+		std::map<uint32_t, uint32_t> pointees;
+		std::map<uint32_t, std::vector<const std::vector<uint32_t>*>> functions;
+		std::vector<const std::vector<uint32_t>*> variables;
+		uint32_t entryPoint = 0;
+		bool vertexShader = false;
+		uint32_t function = 0;
+		for (auto& instruction : module.instructions) {
+			uint32_t op = SpirVModule::opcode(instruction);
+			if (op == OpEntryPoint && entryPoint == 0) {
+				entryPoint = instruction[2];
+				vertexShader = instruction[1] == ExecutionModelVertex;
+			}
+			else if (op == OpTypePointer) {
+				pointees[instruction[1]] = instruction[3];
+			}
+			else if (op == OpFunction) {
+				function = instruction[2];
+			}
+			else if (op == OpFunctionEnd) {
+				function = 0;
+			}
+			else if (function != 0) {
+				functions[function].push_back(&instruction);
+			}
+			else if (op == OpVariable) {
+				variables.push_back(&instruction);
+			}
+		}
+
+		std::vector<uint32_t> pending(1, entryPoint);
+		while (!pending.empty()) {
+			uint32_t current = pending.back();
+			pending.pop_back();
+			if (!reachable.insert(current).second) continue;
+			for (auto instruction : functions[current]) {
+				if (SpirVModule::opcode(*instruction) == OpFunctionCall) pending.push_back((*instruction)[3]);
+			}
+		}
+
+		std::set<uint32_t> referenced;
+		for (uint32_t id : reachable) {
+			for (auto instruction : functions[id]) {
+				referenced.insert(instruction->begin() + 1, instruction->end());
+			}
+		}
+
+		std::vector<Resource> unused;
+		for (auto variable : variables) {
+			uint32_t id = (*variable)[2];
+			uint32_t storageClass = (*variable)[3];
+			bool resource = storageClass == StorageClassUniformConstant || storageClass == StorageClassUniform
+				|| (storageClass == StorageClassInput && vertexShader);
+			if (!resource || referenced.find(id) != referenced.end() || module.hasDecoration(id, DecorationBuiltIn)) continue;
+			// Uniform blocks without an instance name are known by their block name
+			std::string name = names[id];
+			if (name.empty()) name = names[pointees[(*variable)[1]]];
+			if (name.substr(0, 3) == "gl_") continue;
+			Resource resourceEntry;
+			resourceEntry.id = id;
+			resourceEntry.name = name;
+			unused.push_back(resourceEntry);
+		}
+		return unused;
+	}
+}
+
+std::vector<std::string> krafix::findUnusedResources(const std::vector<uint32_t>& spirv) {
+	std::vector<std::string> names;
+	std::set<uint32_t> reachable;
+	for (auto& resource : unusedResources(SpirVModule(spirv), reachable)) {
+		names.push_back(resource.name);
+	}
+	return names;
+}
+
+std::vector<std::string> krafix::stripUnusedResources(std::vector<uint32_t>& spirv) {
+	SpirVModule module(spirv);
+	std::set<uint32_t> reachable;
+	std::vector<Resource> unused = unusedResources(module, reachable);
+	if (unused.empty()) return std::vector<std::string>();
+
+	std::set<uint32_t> removed;
+	std::vector<std::string> names;
+	for (auto& resource : unused) {
+		removed.insert(resource.id);
+		names.push_back(resource.name);
+		module.removeFromInterface(resource.id);
+	}
+
+	// Functions the entry point never calls could still reference the removed variables
+	std::vector<std::vector<uint32_t>> instructions;
+	bool unreachableFunction = false;
+	for (auto& instruction : module.instructions) {
+		uint32_t op = SpirVModule::opcode(instruction);
+		if (op == OpFunction) unreachableFunction = reachable.find(instruction[2]) == reachable.end();
+		if (unreachableFunction) {
+			uint32_t result = SpirVModule::resultId(instruction);
+			if (result != 0) removed.insert(result);
+			if (op == OpFunctionEnd) unreachableFunction = false;
+			continue;
+		}
+		if (op == OpVariable && removed.find(instruction[2]) != removed.end()) continue;
+		instructions.push_back(instruction);
+	}
+	instructions.erase(std::remove_if(instructions.begin(), instructions.end(), [&removed](const std::vector<uint32_t>& instruction) {
+		uint32_t op = SpirVModule::opcode(instruction);
+		return (op == OpName || op == OpDecorate) && removed.find(instruction[1]) != removed.end();
+	}), instructions.end());
+	module.instructions = instructions;
+	spirv = module.assemble();
+	return names;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace krafix {
+	// Returns the names of uniforms, samplers, images, uniform blocks and - in vertex shaders - vertex inputs
+	// which no function reachable from the entry point references.
+	std::vector<std::string> findUnusedResources(const std::vector<uint32_t>& spirv);
+
+	// Removes the resources findUnusedResources reports together with their names, decorations and
+	// entry point interface entries. Returns the names of the removed resources.
+	std::vector<std::string> stripUnusedResources(std::vector<uint32_t>& spirv);
+}
@@ -0,0 +1,35 @@
+#include "Serialization.h"
+
+using namespace krafix;
+
+void krafix::writeWord(std::ostream& out, uint32_t word) {
+	out.put(word & 0xff);
+	out.put((word >> 8) & 0xff);
+	out.put((word >> 16) & 0xff);
+	out.put((word >> 24) & 0xff);
+}
+
+void krafix::writeWord(std::string& out, uint32_t word) {
+	out += (char)(word & 0xff);
+	out += (char)((word >> 8) & 0xff);
+	out += (char)((word >> 16) & 0xff);
+	out += (char)((word >> 24) & 0xff);
+}
+
+std::string krafix::escapeJson(const std::string& text) {
+	std::string escaped;
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+			escaped += c;
+		}
+		else if (c == '\n') escaped += "\\n";
+		else if ((unsigned char)c >= 0x20) escaped += c;
+	}
+	return escaped;
+}
+
+const char* krafix::stageName(ShaderStage stage) {
+	const char* names[] = { "vertex", "tesscontrol", "tessevaluation", "geometry", "fragment", "compute" };
+	return names[stage];
+}
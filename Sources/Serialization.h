@@ -0,0 +1,19 @@
+#pragma once
+
+#include "Translator.h"
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace krafix {
+	// Appends word as little endian uint32, the byte order of all binary sidecars
+	void writeWord(std::ostream& out, uint32_t word);
+	void writeWord(std::string& out, uint32_t word);
+
+	// Text for a JSON string literal, without the quotes
+	std::string escapeJson(const std::string& text);
+
+	// Stage name used in the JSON sidecars and generated identifiers
+	const char* stageName(ShaderStage stage);
+}
@@ -0,0 +1,394 @@
+#include "ShaderCost.h"
+#include "Serialization.h"
+#include "SpirVModule.h"
+
+#include <SPIRV/spirv.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdlib.h>
+
+#ifdef _WIN32
+// Keeps std::min and std::max usable
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+using namespace krafix;
+
+namespace {
+	struct Block {
+		uint32_t label = 0;
+		unsigned weight = 0;
+		std::vector<uint32_t> successors;
+		std::vector<uint32_t> calls;
+	};
+
+	struct Function {
+		std::vector<Block> blocks;
+		std::vector<const std::vector<uint32_t>*> body;
+	};
+
+	bool isFloatAlu(uint32_t op) {
+		return op == spv::OpFNegate || op == spv::OpFAdd || op == spv::OpFSub || op == spv::OpFMul || op == spv::OpFDiv || op == spv::OpFRem
+			|| op == spv::OpFMod || (op >= spv::OpVectorTimesScalar && op <= spv::OpDot);
+	}
+
+	bool isIntegerAlu(uint32_t op) {
+		return op == spv::OpSNegate || op == spv::OpIAdd || op == spv::OpISub || op == spv::OpIMul || op == spv::OpUDiv || op == spv::OpSDiv
+			|| op == spv::OpUMod || op == spv::OpSRem || op == spv::OpSMod || (op >= spv::OpShiftRightLogical && op <= spv::OpNot);
+	}
+
+	bool isTextureAccess(uint32_t op) {
+		return (op >= spv::OpImageSampleImplicitLod && op <= spv::OpImageDrefGather) || op == spv::OpImageRead;
+	}
+
+	bool isTerminator(uint32_t op) {
+		return op == spv::OpBranch || op == spv::OpBranchConditional || op == spv::OpSwitch || op == spv::OpReturn || op == spv::OpReturnValue
+			|| op == spv::OpKill || op == spv::OpUnreachable;
+	}
+
+	// Instructions which do not turn into work on the GPU
+	bool isFree(uint32_t op) {
+		return op == spv::OpLabel || op == spv::OpVariable || op == spv::OpPhi || op == spv::OpLine || op == spv::OpNoLine
+			|| op == spv::OpSelectionMerge || op == spv::OpLoopMerge;
+	}
+
+	unsigned longestPath(const Function& function, size_t block, std::map<uint32_t, size_t>& blockIndices, std::vector<int>& state,
+		std::vector<unsigned>& lengths, const std::map<uint32_t, Function>& functions, std::map<uint32_t, unsigned>& functionLengths);
+
+	unsigned functionLength(uint32_t id, const std::map<uint32_t, Function>& functions, std::map<uint32_t, unsigned>& functionLengths) {
+		auto known = functionLengths.find(id);
+		if (known != functionLengths.end()) return known->second;
+		auto function = functions.find(id);
+		if (function == functions.end() || function->second.blocks.empty()) return 0;
+		// Guards against recursion which SPIR-V shaders do not allow anyway
+		functionLengths[id] = 0;
+
+		std::map<uint32_t, size_t> blockIndices;
+		for (size_t i = 0; i < function->second.blocks.size(); ++i) {
+			blockIndices[function->second.blocks[i].label] = i;
+		}
+		std::vector<int> state(function->second.blocks.size(), 0);
+		std::vector<unsigned> lengths(function->second.blocks.size(), 0);
+		unsigned length = longestPath(function->second, 0, blockIndices, state, lengths, functions, functionLengths);
+		functionLengths[id] = length;
+		return length;
+	}
+
+	// Depth first search which drops edges back to blocks on the current path, so every loop body counts once
+	unsigned longestPath(const Function& function, size_t block, std::map<uint32_t, size_t>& blockIndices, std::vector<int>& state,
+		std::vector<unsigned>& lengths, const std::map<uint32_t, Function>& functions, std::map<uint32_t, unsigned>& functionLengths) {
+		if (state[block] == 2) return lengths[block];
+		state[block] = 1;
+		const Block& current = function.blocks[block];
+		unsigned length = current.weight;
+		for (uint32_t callee : current.calls) {
+			length += functionLength(callee, functions, functionLengths);
+		}
+		unsigned longestSuccessor = 0;
+		for (uint32_t successor : current.successors) {
+			auto index = blockIndices.find(successor);
+			if (index == blockIndices.end() || state[index->second] == 1) continue;
+			longestSuccessor = std::max(longestSuccessor, longestPath(function, index->second, blockIndices, state, lengths, functions, functionLengths));
+		}
+		state[block] = 2;
+		lengths[block] = length + longestSuccessor;
+		return lengths[block];
+	}
+
+	// Linear scan over the function in layout order. Values which are live when a loop starts
+	// stay live until its back edge.
+	unsigned maxLiveValues(const Function& function, const std::set<uint32_t>& types) {
+		std::map<uint32_t, size_t> definitions;
+		std::map<uint32_t, size_t> labels;
+		for (size_t i = 0; i < function.body.size(); ++i) {
+			const std::vector<uint32_t>& instruction = *function.body[i];
+			uint32_t op = SpirVModule::opcode(instruction);
+			if (op == spv::OpLabel) {
+				labels[instruction[1]] = i;
+			}
+			else if (op != spv::OpVariable && instruction.size() > 2 && types.find(instruction[1]) != types.end()) {
+				definitions[instruction[2]] = i;
+			}
+		}
+
+		std::map<uint32_t, size_t> lastUses;
+		std::vector<std::pair<size_t, size_t>> backEdges;
+		for (size_t i = 0; i < function.body.size(); ++i) {
+			const std::vector<uint32_t>& instruction = *function.body[i];
+			uint32_t op = SpirVModule::opcode(instruction);
+			size_t first = (instruction.size() > 2 && types.find(instruction[1]) != types.end()) ? 3 : 1;
+			for (size_t word = first; word < instruction.size(); ++word) {
+				if (definitions.find(instruction[word]) != definitions.end()) {
+					lastUses[instruction[word]] = std::max(lastUses[instruction[word]], i);
+				}
+				if (isTerminator(op)) {
+					auto label = labels.find(instruction[word]);
+					if (label != labels.end() && label->second < i) backEdges.push_back(std::make_pair(label->second, i));
+				}
+			}
+		}
+
+		std::vector<int> changes(function.body.size() + 1, 0);
+		for (auto definition : definitions) {
+			size_t end = definition.second;
+			auto use = lastUses.find(definition.first);
+			if (use != lastUses.end()) end = std::max(end, use->second);
+			for (auto edge : backEdges) {
+				if (definition.second < edge.first && end >= edge.first) end = std::max(end, edge.second);
+			}
+			++changes[definition.second];
+			--changes[end + 1];
+		}
+		int live = 0;
+		int maxLive = 0;
+		for (int change : changes) {
+			live += change;
+			maxLive = std::max(maxLive, live);
+		}
+		return (unsigned)maxLive;
+	}
+
+	const std::string costExtension = ".cost.json";
+
+	bool endsWith(const std::string& text, const std::string& end) {
+		return text.size() >= end.size() && text.compare(text.size() - end.size(), end.size(), end) == 0;
+	}
+
+	// Collects the paths of all cost files below directory, relative to it
+	void findCostFiles(const std::string& directory, const std::string& relative, std::vector<std::string>& files) {
+#ifdef _WIN32
+		WIN32_FIND_DATAA data;
+		HANDLE handle = FindFirstFileA((directory + "\\" + relative + "*").c_str(), &data);
+		if (handle == INVALID_HANDLE_VALUE) return;
+		do {
+			std::string name = data.cFileName;
+			if (name == "." || name == "..") continue;
+			if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) findCostFiles(directory, relative + name + "/", files);
+			else if (endsWith(name, costExtension)) files.push_back(relative + name);
+		} while (FindNextFileA(handle, &data));
+		FindClose(handle);
+#else
+		DIR* dir = opendir((directory + "/" + relative).c_str());
+		if (dir == nullptr) return;
+		while (dirent* entry = readdir(dir)) {
+			std::string name = entry->d_name;
+			if (name == "." || name == "..") continue;
+			struct stat info;
+			if (stat((directory + "/" + relative + name).c_str(), &info) != 0) continue;
+			if (S_ISDIR(info.st_mode)) findCostFiles(directory, relative + name + "/", files);
+			else if (endsWith(name, costExtension)) files.push_back(relative + name);
+		}
+		closedir(dir);
+#endif
+	}
+
+	// Only reads the flat numeric members of the files written by costJson
+	double readCostValue(const std::string& json, const std::string& key) {
+		size_t position = json.find("\"" + key + "\":");
+		if (position == std::string::npos) return 0;
+		return atof(json.c_str() + position + key.size() + 3);
+	}
+
+	long long fileSize(const std::string& filename) {
+		std::ifstream file(filename.c_str(), std::ios::binary | std::ios::ate);
+		if (!file.is_open()) return 0;
+		return (long long)file.tellg();
+	}
+
+	bool grew(double before, double after, double threshold) {
+		return after > before && after - before > before * threshold / 100.0;
+	}
+}
+
+ShaderCost krafix::estimateCost(const std::vector<uint32_t>& spirv) {
+	ShaderCost cost;
+	SpirVModule module(spirv);
+
+	std::set<uint32_t> types;
+	std::map<uint32_t, Function> functions;
+	uint32_t entryPoint = 0;
+	Function* function = nullptr;
+	Block* block = nullptr;
+	for (auto& instruction : module.instructions) {
+		uint32_t op = SpirVModule::opcode(instruction);
+		if (op >= spv::OpTypeVoid && op <= spv::OpTypeForwardPointer && instruction.size() > 1) {
+			types.insert(instruction[1]);
+		}
+		else if (op == spv::OpEntryPoint && entryPoint == 0 && instruction.size() > 2) {
+			entryPoint = instruction[2];
+		}
+		else if (op == spv::OpFunction) {
+			function = &functions[instruction[2]];
+		}
+		else if (op == spv::OpFunctionEnd) {
+			function = nullptr;
+			block = nullptr;
+		}
+		if (function == nullptr || op == spv::OpFunction || op == spv::OpFunctionParameter) continue;
+
+		function->body.push_back(&instruction);
+		if (op == spv::OpLabel) {
+			function->blocks.push_back(Block());
+			block = &function->blocks.back();
+			block->label = instruction[1];
+			continue;
+		}
+		if (block == nullptr) continue;
+
+		if (!isFree(op)) {
+			++block->weight;
+			++cost.instructions;
+		}
+		if (isFloatAlu(op)) ++cost.floatAlu;
+		else if (isIntegerAlu(op)) ++cost.integerAlu;
+		else if (op >= spv::OpConvertFToU && op <= spv::OpBitcast) ++cost.conversions;
+		else if (op >= spv::OpAny && op <= spv::OpFUnordGreaterThanEqual) ++cost.comparisons;
+		else if (op == spv::OpExtInst) ++cost.builtinCalls;
+		else if (op >= spv::OpDPdx && op <= spv::OpFwidthCoarse) ++cost.derivatives;
+		else if (isTextureAccess(op)) ++cost.textureSamples;
+		else if (op == spv::OpLoopMerge) ++cost.loops;
+		else if (op == spv::OpFunctionCall) block->calls.push_back(instruction[3]);
+		else if (op == spv::OpBranch) block->successors.push_back(instruction[1]);
+		else if (op == spv::OpBranchConditional) {
+			++cost.branches;
+			block->successors.push_back(instruction[2]);
+			block->successors.push_back(instruction[3]);
+		}
+		else if (op == spv::OpSwitch) {
+			++cost.branches;
+			block->successors.push_back(instruction[2]);
+			for (size_t i = 4; i < instruction.size(); i += 2) {
+				block->successors.push_back(instruction[i]);
+			}
+		}
+	}
+
+	// A texture access is dependent when its coordinate was computed from another texture access
+	std::set<uint32_t> tainted;
+	std::map<uint32_t, uint32_t> accessChainBases;
+	for (auto& entry : functions) {
+		for (auto instructionPointer : entry.second.body) {
+			const std::vector<uint32_t>& instruction = *instructionPointer;
+			uint32_t op = SpirVModule::opcode(instruction);
+			if (op == spv::OpStore && instruction.size() > 2) {
+				if (tainted.count(instruction[2]) > 0) {
+					tainted.insert(instruction[1]);
+					if (accessChainBases.count(instruction[1]) > 0) tainted.insert(accessChainBases[instruction[1]]);
+				}
+				continue;
+			}
+			if (instruction.size() < 3 || types.find(instruction[1]) == types.end()) continue;
+			uint32_t result = instruction[2];
+			if ((op == spv::OpAccessChain || op == spv::OpInBoundsAccessChain) && instruction.size() > 3) {
+				accessChainBases[result] = accessChainBases.count(instruction[3]) > 0 ? accessChainBases[instruction[3]] : instruction[3];
+			}
+			if (isTextureAccess(op)) {
+				if (instruction.size() > 4 && tainted.count(instruction[4]) > 0) ++cost.dependentTextureReads;
+				tainted.insert(result);
+				continue;
+			}
+			if (op == spv::OpLoad && instruction.size() > 3 && accessChainBases.count(instruction[3]) > 0
+				&& tainted.count(accessChainBases[instruction[3]]) > 0) {
+				tainted.insert(result);
+				continue;
+			}
+			for (size_t word = 3; word < instruction.size(); ++word) {
+				if (tainted.count(instruction[word]) > 0) {
+					tainted.insert(result);
+					break;
+				}
+			}
+		}
+	}
+
+	std::map<uint32_t, unsigned> functionLengths;
+	cost.worstCasePath = functionLength(entryPoint, functions, functionLengths);
+	if (functions.find(entryPoint) != functions.end()) {
+		cost.temporaries = maxLiveValues(functions[entryPoint], types);
+	}
+	return cost;
+}
+
+std::string krafix::costJson(const ShaderCost& cost, ShaderStage stage, const std::string& file, bool pretty) {
+	const char* newline = pretty ? "\n" : "";
+	const char* indent = pretty ? "\t" : "";
+	const char* space = pretty ? " " : "";
+
+	std::ostringstream out;
+	out << "{" << newline;
+	out << indent << "\"file\":" << space << "\"" << escapeJson(file) << "\"," << newline;
+	out << indent << "\"stage\":" << space << "\"" << stageName(stage) << "\"," << newline;
+	out << indent << "\"instructions\":" << space << cost.instructions << "," << newline;
+	out << indent << "\"alu\":" << space << "{" << space;
+	out << "\"float\":" << space << cost.floatAlu << "," << space;
+	out << "\"integer\":" << space << cost.integerAlu << "," << space;
+	out << "\"conversion\":" << space << cost.conversions << "," << space;
+	out << "\"comparison\":" << space << cost.comparisons << "," << space;
+	out << "\"builtin\":" << space << cost.builtinCalls << "," << space;
+	out << "\"derivative\":" << space << cost.derivatives << space << "}," << newline;
+	out << indent << "\"textureSamples\":" << space << cost.textureSamples << "," << newline;
+	out << indent << "\"dependentTextureReads\":" << space << cost.dependentTextureReads << "," << newline;
+	out << indent << "\"branches\":" << space << cost.branches << "," << newline;
+	out << indent << "\"loops\":" << space << cost.loops << "," << newline;
+	out << indent << "\"worstCasePath\":" << space << cost.worstCasePath << "," << newline;
+	out << indent << "\"temporaries\":" << space << cost.temporaries << newline;
+	out << "}";
+	return out.str();
+}
+
+int krafix::compareCosts(const std::string& oldDirectory, const std::string& newDirectory, double threshold) {
+	std::vector<std::string> oldFiles;
+	std::vector<std::string> newFiles;
+	findCostFiles(oldDirectory, "", oldFiles);
+	findCostFiles(newDirectory, "", newFiles);
+	std::sort(newFiles.begin(), newFiles.end());
+	std::set<std::string> oldSet(oldFiles.begin(), oldFiles.end());
+
+	const char* keys[] = { "instructions", "textureSamples", "worstCasePath" };
+	int regressions = 0;
+	for (auto& file : newFiles) {
+		std::string output = file.substr(0, file.size() - costExtension.size());
+		if (oldSet.find(file) == oldSet.end()) {
+			std::cout << output << ": new" << std::endl;
+			continue;
+		}
+		oldSet.erase(file);
+
+		std::ifstream oldStream((oldDirectory + "/" + file).c_str());
+		std::ifstream newStream((newDirectory + "/" + file).c_str());
+		std::string oldJson((std::istreambuf_iterator<char>(oldStream)), std::istreambuf_iterator<char>());
+		std::string newJson((std::istreambuf_iterator<char>(newStream)), std::istreambuf_iterator<char>());
+
+		bool regressed = false;
+		for (const char* key : keys) {
+			double before = readCostValue(oldJson, key);
+			double after = readCostValue(newJson, key);
+			if (grew(before, after, threshold)) {
+				std::cout << output << ": " << key << " " << before << " -> " << after << std::endl;
+				regressed = true;
+			}
+		}
+		long long oldSize = fileSize(oldDirectory + "/" + output);
+		long long newSize = fileSize(newDirectory + "/" + output);
+		if (grew((double)oldSize, (double)newSize, threshold)) {
+			std::cout << output << ": size " << oldSize << " -> " << newSize << std::endl;
+			regressed = true;
+		}
+		if (regressed) ++regressions;
+	}
+	for (auto& file : oldSet) {
+		std::cout << file.substr(0, file.size() - costExtension.size()) << ": removed" << std::endl;
+	}
+
+	std::cout << regressions << " of " << newFiles.size() << " outputs grew by more than " << threshold << "%" << std::endl;
+	return regressions;
+}
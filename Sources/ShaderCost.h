@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Translator.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace krafix {
+	// Static per stage metrics, everything is counted in SPIR-V instructions.
+	struct ShaderCost {
+		unsigned instructions = 0;
+		unsigned floatAlu = 0;
+		unsigned integerAlu = 0;
+		unsigned conversions = 0;
+		unsigned comparisons = 0;
+		unsigned builtinCalls = 0;
+		unsigned derivatives = 0;
+		unsigned textureSamples = 0;
+		unsigned dependentTextureReads = 0;
+		unsigned branches = 0;
+		unsigned loops = 0;
+		// Longest path through the entry point with every loop body taken once and calls inlined
+		unsigned worstCasePath = 0;
+		// Maximum number of simultaneously live SSA values in the entry point
+		unsigned temporaries = 0;
+	};
+
+	ShaderCost estimateCost(const std::vector<uint32_t>& spirv);
+	std::string costJson(const ShaderCost& cost, ShaderStage stage, const std::string& file, bool pretty);
+
+	// Compares the .cost.json files of two output directories, matched by relative path, and prints
+	// every output whose instruction count, texture accesses or output size grew by more than
+	// threshold percent. Returns the number of regressions.
+	int compareCosts(const std::string& oldDirectory, const std::string& newDirectory, double threshold);
+}
@@ -0,0 +1,242 @@
+#include "ShaderModel.h"
+#include "ShaderCost.h"
+#include "SpirVModule.h"
+
+#include <SPIRV/spirv.hpp>
+#include <SPIRV/GLSL.std.450.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+using namespace krafix;
+
+namespace {
+	using namespace spv;
+
+	// D3D10 has 16 vertex input and interpolator registers, D3D11 32
+	const unsigned sm4InterfaceRegisters = 16;
+	// cs_4_0 thread groups
+	const unsigned sm4ComputeThreads = 768;
+	// ps_2_0 instruction slots and registers
+	const unsigned ps2ArithmeticSlots = 64;
+	const unsigned ps2TextureSlots = 32;
+	const unsigned ps2DependentReads = 4;
+	const unsigned ps2TextureCoordinates = 8;
+	const unsigned ps2Constants = 32;
+	const unsigned ps2Temporaries = 12;
+	// vs_2_0 instruction slots
+	const unsigned vs2Slots = 256;
+
+	struct ModuleFeatures {
+		std::set<uint32_t> capabilities;
+		std::set<uint32_t> executionModes;
+		std::set<uint32_t> builtIns;
+		std::set<uint32_t> opcodes;
+		std::set<uint32_t> glslInstructions;
+		unsigned inputRegisters = 0;
+		unsigned outputRegisters = 0;
+		unsigned constantRegisters = 0;
+		unsigned localSize = 1;
+		bool storageResources = false;
+		bool workgroupMemory = false;
+	};
+
+	class Registers {
+	public:
+		Registers(const SpirVModule& module) : module(module) {
+			for (auto& instruction : module.instructions) {
+				if (SpirVModule::opcode(instruction) == OpConstant) constants[instruction[2]] = instruction[3];
+			}
+		}
+
+		// vec4 registers a value of the type occupies in D3D9 constants and interpolators
+		unsigned count(uint32_t type) const {
+			const std::vector<uint32_t>* declaration = module.findType(type);
+			if (declaration == nullptr) return 0;
+			switch (SpirVModule::opcode(*declaration)) {
+			case OpTypeBool:
+			case OpTypeInt:
+			case OpTypeFloat:
+			case OpTypeVector:
+				return 1;
+			case OpTypeMatrix:
+				return (*declaration)[3];
+			case OpTypeArray: {
+				auto length = constants.find((*declaration)[3]);
+				return count((*declaration)[2]) * (length == constants.end() ? 1 : length->second);
+			}
+			case OpTypeStruct: {
+				unsigned sum = 0;
+				for (size_t i = 2; i < declaration->size(); ++i) sum += count((*declaration)[i]);
+				return sum;
+			}
+			default:
+				return 0;
+			}
+		}
+
+		bool opaque(uint32_t type) const {
+			const std::vector<uint32_t>* declaration = module.findType(type);
+			if (declaration == nullptr) return false;
+			uint32_t op = SpirVModule::opcode(*declaration);
+			if (op == OpTypeArray) return opaque((*declaration)[2]);
+			return op == OpTypeImage || op == OpTypeSampler || op == OpTypeSampledImage;
+		}
+
+	private:
+		const SpirVModule& module;
+		std::map<uint32_t, uint32_t> constants;
+	};
+
+	ModuleFeatures findFeatures(const std::vector<uint32_t>& spirv) {
+		SpirVModule module(spirv);
+		Registers registers(module);
+		ModuleFeatures features;
+
+		uint32_t glslExtension = 0;
+		std::set<uint32_t> builtInIds;
+		std::set<uint32_t> bufferBlocks;
+		std::map<uint32_t, uint32_t> pointees;
+		for (auto& instruction : module.instructions) {
+			uint32_t op = SpirVModule::opcode(instruction);
+			switch (op) {
+			case OpCapability:
+				features.capabilities.insert(instruction[1]);
+				break;
+			case OpExtInstImport:
+				if (std::string((const char*)&instruction[2]) == "GLSL.std.450") glslExtension = instruction[1];
+				break;
+			case OpExecutionMode:
+				features.executionModes.insert(instruction[2]);
+				if (instruction[2] == ExecutionModeLocalSize && instruction.size() >= 6) {
+					features.localSize = instruction[3] * instruction[4] * instruction[5];
+				}
+				break;
+			case OpDecorate:
+				if (instruction[2] == DecorationBuiltIn) {
+					features.builtIns.insert(instruction[3]);
+					builtInIds.insert(instruction[1]);
+				}
+				else if (instruction[2] == DecorationBufferBlock) {
+					bufferBlocks.insert(instruction[1]);
+				}
+				break;
+			case OpMemberDecorate:
+				if (instruction[3] == DecorationBuiltIn) {
+					features.builtIns.insert(instruction[4]);
+					builtInIds.insert(instruction[1]);
+				}
+				break;
+			case OpTypeImage:
+				// Sampled 2 means read/write access, an unordered access view in D3D
+				if (instruction[7] == 2) features.storageResources = true;
+				break;
+			case OpTypePointer:
+				pointees[instruction[1]] = instruction[3];
+				break;
+			case OpExtInst:
+				if (instruction[3] == glslExtension) features.glslInstructions.insert(instruction[4]);
+				break;
+			}
+			features.opcodes.insert(op);
+		}
+
+		for (auto& instruction : module.instructions) {
+			if (SpirVModule::opcode(instruction) != OpVariable) continue;
+			uint32_t type = pointees[instruction[1]];
+			switch (instruction[3]) {
+			case StorageClassInput:
+				if (builtInIds.count(instruction[2]) == 0 && builtInIds.count(type) == 0) features.inputRegisters += registers.count(type);
+				break;
+			case StorageClassOutput:
+				if (builtInIds.count(instruction[2]) == 0 && builtInIds.count(type) == 0) features.outputRegisters += registers.count(type);
+				break;
+			case StorageClassUniformConstant:
+				if (!registers.opaque(type)) features.constantRegisters += registers.count(type);
+				break;
+			case StorageClassUniform:
+				if (bufferBlocks.count(type) != 0) features.storageResources = true;
+				break;
+			case StorageClassStorageBuffer:
+				features.storageResources = true;
+				break;
+			case StorageClassWorkgroup:
+				features.workgroupMemory = true;
+				break;
+			}
+		}
+		return features;
+	}
+
+	bool requiresShaderModel5(const ModuleFeatures& features, ShaderStage stage) {
+		if (stage == StageTessControl || stage == StageTessEvaluation) return true;
+
+		const uint32_t capabilities[] = { CapabilityFloat64, CapabilityInt64, CapabilityImageGatherExtended, CapabilityStorageImageMultisample,
+			CapabilityImageCubeArray, CapabilitySampleRateShading, CapabilitySampledCubeArray, CapabilityImageMSArray, CapabilityDerivativeControl,
+			CapabilityInterpolationFunction, CapabilityGeometryStreams, CapabilityMinLod, CapabilitySparseResidency };
+		for (uint32_t capability : capabilities) {
+			if (features.capabilities.count(capability) != 0) return true;
+		}
+
+		// Gathers, LOD queries and bit operations came with D3D10.1 and D3D11, fxc only offers them in the _5_0 profiles
+		const uint32_t opcodes[] = { OpImageGather, OpImageDrefGather, OpImageQueryLod, OpBitFieldInsert, OpBitFieldSExtract, OpBitFieldUExtract,
+			OpBitReverse, OpBitCount };
+		for (uint32_t op : opcodes) {
+			if (features.opcodes.count(op) != 0) return true;
+		}
+		for (uint32_t op = OpAtomicLoad; op <= OpAtomicXor; ++op) {
+			if (features.opcodes.count(op) != 0) return true;
+		}
+		const uint32_t glslInstructions[] = { GLSLstd450FindILsb, GLSLstd450FindSMsb, GLSLstd450FindUMsb, GLSLstd450PackHalf2x16, GLSLstd450UnpackHalf2x16 };
+		for (uint32_t instruction : glslInstructions) {
+			if (features.glslInstructions.count(instruction) != 0) return true;
+		}
+
+		if (features.executionModes.count(ExecutionModeEarlyFragmentTests) != 0 || features.executionModes.count(ExecutionModeDepthGreater) != 0
+			|| features.executionModes.count(ExecutionModeDepthLess) != 0) {
+			return true;
+		}
+		if (features.builtIns.count(BuiltInSampleId) != 0 || features.builtIns.count(BuiltInSamplePosition) != 0 || features.builtIns.count(BuiltInSampleMask) != 0) {
+			return true;
+		}
+
+		if (features.storageResources) return true;
+		if (stage == StageCompute && (features.workgroupMemory || features.localSize > sm4ComputeThreads)) return true;
+		return features.inputRegisters > sm4InterfaceRegisters || features.outputRegisters > sm4InterfaceRegisters;
+	}
+
+	bool requiresShaderModel3(const std::vector<uint32_t>& spirv, const ModuleFeatures& features, ShaderStage stage) {
+		ShaderCost cost = estimateCost(spirv);
+		if (stage == StageVertex) {
+			return cost.textureSamples > 0 || cost.instructions > vs2Slots;
+		}
+
+		if (features.builtIns.count(BuiltInFragCoord) != 0 || features.builtIns.count(BuiltInFrontFacing) != 0) return true;
+		const uint32_t explicitLod[] = { OpImageSampleExplicitLod, OpImageSampleDrefExplicitLod, OpImageSampleProjExplicitLod, OpImageSampleProjDrefExplicitLod };
+		for (uint32_t op : explicitLod) {
+			if (features.opcodes.count(op) != 0) return true;
+		}
+		// ps_2_0 has no derivatives and no dynamic flow control, loops only compile when fxc can unroll them
+		if (cost.derivatives > 0 || cost.loops > 0) return true;
+		if (cost.textureSamples > ps2TextureSlots || cost.dependentTextureReads > ps2DependentReads) return true;
+		if (cost.floatAlu + cost.builtinCalls + cost.conversions + cost.comparisons > ps2ArithmeticSlots) return true;
+		if (cost.temporaries > ps2Temporaries) return true;
+		return features.inputRegisters > ps2TextureCoordinates || features.constantRegisters > ps2Constants;
+	}
+}
+
+int krafix::inferShaderModel(const std::vector<uint32_t>& spirv, ShaderStage stage, bool d3d9) {
+	ModuleFeatures features = findFeatures(spirv);
+	if (d3d9) {
+		return requiresShaderModel3(spirv, features, stage) ? 30 : 20;
+	}
+	return requiresShaderModel5(features, stage) ? 50 : 40;
+}
+
+std::string krafix::shaderProfile(ShaderStage stage, int shaderModel) {
+	const char* prefixes[] = { "vs", "hs", "ds", "gs", "ps", "cs" };
+	if (shaderModel < 40 && stage != StageVertex && stage != StageFragment) return "";
+	if (shaderModel < 50 && (stage == StageTessControl || stage == StageTessEvaluation)) return "";
+	return std::string(prefixes[stage]) + "_" + std::to_string(shaderModel / 10) + "_" + std::to_string(shaderModel % 10);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Translator.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace krafix {
+	// Smallest shader model the D3D compilers can build the module for, encoded like SPIRV-Cross' shader_model
+	// option (20 = 2.0, 30, 40, 50). d3d9 chooses between 20 and 30, otherwise between 40 and 50. Looks at the
+	// capabilities, stage, execution modes, built-ins, interface and constant register counts and the instructions.
+	int inferShaderModel(const std::vector<uint32_t>& spirv, ShaderStage stage, bool d3d9);
+
+	// D3DCompile profile like "ps_4_0", empty for stages the shader model does not support
+	std::string shaderProfile(ShaderStage stage, int shaderModel);
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+/*
+ * Decoder for krafix' compact SPIR-V encoding (written by krafix --spirv-compact).
+ * Single header, no dependencies, usable from C and C++.
+ *
+ * Layout: "KSPC", varint format version, varint decoded word count, varint SPIR-V version,
+ * generator, bound and schema (the magic number is implied), followed by the instructions.
+ * Every instruction starts with varint (opcode << 4 | min(word count, 15)), followed by
+ * varint (word count - 15) for long instructions. Result ids are zigzag deltas to the previous
+ * result id, id operands are zigzag deltas to the instruction's result id (or to the previous
+ * id operand for instructions without a result), all other words are plain varints.
+ *
+ *   size_t size = krafix_spirv_compact_decoded_size(data, dataSize);
+ *   uint32_t* words = (uint32_t*)malloc(size);
+ *   krafix_spirv_compact_decode(data, dataSize, words, size / 4);
+ *   // words and size can now be passed to vkCreateShaderModule
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define KRAFIX_SPIRV_COMPACT_VERSION 1
+
+#define KRAFIX_SPIRV_COMPACT_TYPE 0x1
+#define KRAFIX_SPIRV_COMPACT_RESULT 0x2
+#define KRAFIX_SPIRV_COMPACT_IDS(first, count) (((uint32_t)(first) << 8) | ((uint32_t)(count) << 16))
+#define KRAFIX_SPIRV_COMPACT_ALL_IDS(first) KRAFIX_SPIRV_COMPACT_IDS(first, 0xff)
+
+/* Describes which operands of an instruction are ids, operand indices do not include the type and result. */
+static inline uint32_t krafix_spirv_compact_layout(uint32_t opcode) {
+	const uint32_t type_result = KRAFIX_SPIRV_COMPACT_TYPE | KRAFIX_SPIRV_COMPACT_RESULT;
+	switch (opcode) {
+	case 5:  /* OpName */
+	case 6:  /* OpMemberName */
+	case 8:  /* OpLine */
+	case 16: /* OpExecutionMode */
+	case 71: /* OpDecorate */
+	case 72: /* OpMemberDecorate */
+	case 247: /* OpSelectionMerge */
+		return KRAFIX_SPIRV_COMPACT_IDS(0, 1);
+	case 7:  /* OpString */
+	case 11: /* OpExtInstImport */
+	case 19: /* OpTypeVoid */
+	case 20: /* OpTypeBool */
+	case 21: /* OpTypeInt */
+	case 22: /* OpTypeFloat */
+	case 26: /* OpTypeSampler */
+	case 73: /* OpDecorationGroup */
+	case 248: /* OpLabel */
+		return KRAFIX_SPIRV_COMPACT_RESULT;
+	case 15: /* OpEntryPoint */
+		return KRAFIX_SPIRV_COMPACT_IDS(1, 1);
+	case 23: /* OpTypeVector */
+	case 24: /* OpTypeMatrix */
+	case 25: /* OpTypeImage */
+	case 27: /* OpTypeSampledImage */
+	case 29: /* OpTypeRuntimeArray */
+		return KRAFIX_SPIRV_COMPACT_RESULT | KRAFIX_SPIRV_COMPACT_IDS(0, 1);
+	case 28: /* OpTypeArray */
+		return KRAFIX_SPIRV_COMPACT_RESULT | KRAFIX_SPIRV_COMPACT_IDS(0, 2);
+	case 30: /* OpTypeStruct */
+	case 33: /* OpTypeFunction */
+		return KRAFIX_SPIRV_COMPACT_RESULT | KRAFIX_SPIRV_COMPACT_ALL_IDS(0);
+	case 32: /* OpTypePointer */
+		return KRAFIX_SPIRV_COMPACT_RESULT | KRAFIX_SPIRV_COMPACT_IDS(1, 1);
+	case 41: /* OpConstantTrue */
+	case 42: /* OpConstantFalse */
+	case 43: /* OpConstant */
+	case 46: /* OpConstantNull */
+	case 48: /* OpSpecConstantTrue */
+	case 49: /* OpSpecConstantFalse */
+	case 50: /* OpSpecConstant */
+	case 55: /* OpFunctionParameter */
+		return type_result;
+	case 54: /* OpFunction */
+	case 59: /* OpVariable */
+	case 52: /* OpSpecConstantOp */
+		return type_result | KRAFIX_SPIRV_COMPACT_ALL_IDS(1);
+	case 61: /* OpLoad */
+	case 81: /* OpCompositeExtract */
+		return type_result | KRAFIX_SPIRV_COMPACT_IDS(0, 1);
+	case 79: /* OpVectorShuffle */
+	case 82: /* OpCompositeInsert */
+		return type_result | KRAFIX_SPIRV_COMPACT_IDS(0, 2);
+	case 62: /* OpStore */
+	case 63: /* OpCopyMemory */
+	case 246: /* OpLoopMerge */
+	case 251: /* OpSwitch */
+		return KRAFIX_SPIRV_COMPACT_IDS(0, 2);
+	case 250: /* OpBranchConditional */
+		return KRAFIX_SPIRV_COMPACT_IDS(0, 3);
+	case 74: /* OpGroupDecorate */
+	case 99: /* OpImageWrite */
+	case 224: /* OpControlBarrier */
+	case 225: /* OpMemoryBarrier */
+	case 249: /* OpBranch */
+	case 254: /* OpReturnValue */
+	case 332: /* OpDecorateId */
+		return KRAFIX_SPIRV_COMPACT_ALL_IDS(0);
+	default:
+		break;
+	}
+	if ((opcode >= 44 && opcode <= 45)     /* OpConstantComposite, OpConstantSampler */
+		|| opcode == 51                    /* OpSpecConstantComposite */
+		|| opcode == 12                    /* OpExtInst */
+		|| opcode == 57                    /* OpFunctionCall */
+		|| (opcode >= 65 && opcode <= 70)  /* access chains, OpArrayLength, OpGenericPtrMemSemantics */
+		|| (opcode >= 77 && opcode <= 78)  /* OpVectorExtractDynamic, OpVectorInsertDynamic */
+		|| opcode == 80                    /* OpCompositeConstruct */
+		|| (opcode >= 83 && opcode <= 98)  /* OpCopyObject to OpImageRead */
+		|| (opcode >= 100 && opcode <= 216) /* image queries, conversions, arithmetic, relational, bit and derivative instructions */
+		|| (opcode >= 227 && opcode <= 242) /* atomics */
+		|| opcode == 245) {                /* OpPhi */
+		return type_result | KRAFIX_SPIRV_COMPACT_ALL_IDS(0);
+	}
+	return 0;
+}
+
+static inline int krafix_spirv_compact_read_varint(const uint8_t* data, size_t size, size_t* index, uint32_t* value) {
+	uint32_t result = 0;
+	unsigned shift = 0;
+	while (*index < size && shift < 35) {
+		uint8_t byte = data[(*index)++];
+		result |= (uint32_t)(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0) {
+			*value = result;
+			return 1;
+		}
+		shift += 7;
+	}
+	return 0;
+}
+
+static inline uint32_t krafix_spirv_compact_unzigzag(uint32_t value, uint32_t reference) {
+	return reference + ((value >> 1) ^ (0u - (value & 1)));
+}
+
+/* Returns the size of the decoded module in bytes or 0 when the data is not compact SPIR-V. */
+static inline size_t krafix_spirv_compact_decoded_size(const uint8_t* data, size_t size) {
+	size_t index = 4;
+	uint32_t version, words;
+	if (size < 4 || data[0] != 'K' || data[1] != 'S' || data[2] != 'P' || data[3] != 'C') return 0;
+	if (!krafix_spirv_compact_read_varint(data, size, &index, &version) || version != KRAFIX_SPIRV_COMPACT_VERSION) return 0;
+	if (!krafix_spirv_compact_read_varint(data, size, &index, &words)) return 0;
+	return (size_t)words * 4;
+}
+
+/* Decodes into words which has to hold at least krafix_spirv_compact_decoded_size / 4 words. Returns 1 on success. */
+static inline int krafix_spirv_compact_decode(const uint8_t* data, size_t size, uint32_t* words, size_t capacity) {
+	size_t index = 4;
+	size_t out = 0;
+	uint32_t version, count, value, i;
+	uint32_t last_result = 0, last_id = 0;
+
+	if (size < 4 || data[0] != 'K' || data[1] != 'S' || data[2] != 'P' || data[3] != 'C') return 0;
+	if (!krafix_spirv_compact_read_varint(data, size, &index, &version) || version != KRAFIX_SPIRV_COMPACT_VERSION) return 0;
+	if (!krafix_spirv_compact_read_varint(data, size, &index, &count) || count < 5 || count > capacity) return 0;
+
+	words[out++] = 0x07230203;
+	for (i = 0; i < 4; ++i) {
+		if (!krafix_spirv_compact_read_varint(data, size, &index, &value)) return 0;
+		words[out++] = value;
+	}
+
+	while (index < size) {
+		uint32_t head, opcode, word_count, layout, first_id, id_count, operand, has_type, has_result, result = 0;
+		if (!krafix_spirv_compact_read_varint(data, size, &index, &head)) return 0;
+		opcode = head >> 4;
+		word_count = head & 0xf;
+		if (word_count == 15) {
+			if (!krafix_spirv_compact_read_varint(data, size, &index, &value)) return 0;
+			word_count += value;
+		}
+		if (word_count == 0 || out + word_count > count) return 0;
+
+		layout = krafix_spirv_compact_layout(opcode);
+		has_type = layout & KRAFIX_SPIRV_COMPACT_TYPE;
+		has_result = (layout & KRAFIX_SPIRV_COMPACT_RESULT) >> 1;
+		first_id = (layout >> 8) & 0xff;
+		id_count = (layout >> 16) & 0xff;
+
+		words[out++] = (word_count << 16) | opcode;
+		for (operand = 0; operand < word_count - 1; ++operand) {
+			if (!krafix_spirv_compact_read_varint(data, size, &index, &value)) return 0;
+			if (has_type && operand == 0) {
+				words[out++] = value;
+			}
+			else if (has_result && operand == has_type) {
+				result = last_result = krafix_spirv_compact_unzigzag(value, last_result);
+				words[out++] = result;
+			}
+			else {
+				uint32_t position = operand - has_type - has_result;
+				if (id_count != 0 && position >= first_id && (id_count == 0xff || position < first_id + id_count)) {
+					uint32_t id = krafix_spirv_compact_unzigzag(value, has_result ? result : last_id);
+					if (!has_result) last_id = id;
+					words[out++] = id;
+				}
+				else {
+					words[out++] = value;
+				}
+			}
+		}
+	}
+
+	return out == count;
+}
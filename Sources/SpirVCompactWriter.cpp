@@ -0,0 +1,73 @@
+#include "SpirVCompactWriter.h"
+#include "SpirVCompact.h"
+
+using namespace krafix;
+
+namespace {
+	void writeVarint(std::vector<uint8_t>& out, uint32_t value) {
+		while (value >= 0x80) {
+			out.push_back((uint8_t)(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back((uint8_t)value);
+	}
+
+	uint32_t zigzag(uint32_t value, uint32_t reference) {
+		uint32_t delta = value - reference;
+		return (delta << 1) ^ ((delta & 0x80000000u) ? 0xffffffffu : 0u);
+	}
+}
+
+// Inverse of krafix_spirv_compact_decode in SpirVCompact.h
+void krafix::compactSpirv(const std::vector<uint32_t>& spirv, std::vector<uint8_t>& out) {
+	out.push_back('K');
+	out.push_back('S');
+	out.push_back('P');
+	out.push_back('C');
+	writeVarint(out, KRAFIX_SPIRV_COMPACT_VERSION);
+	writeVarint(out, (uint32_t)spirv.size());
+	for (unsigned i = 1; i < 5; ++i) {
+		writeVarint(out, spirv[i]);
+	}
+
+	uint32_t lastResult = 0;
+	uint32_t lastId = 0;
+	unsigned wordCount = 1;
+	for (unsigned index = 5; index < spirv.size(); index += wordCount) {
+		wordCount = spirv[index] >> 16;
+		uint32_t opcode = spirv[index] & 0xffff;
+
+		writeVarint(out, (opcode << 4) | (wordCount < 15 ? wordCount : 15));
+		if (wordCount >= 15) {
+			writeVarint(out, wordCount - 15);
+		}
+
+		uint32_t layout = krafix_spirv_compact_layout(opcode);
+		uint32_t hasType = layout & KRAFIX_SPIRV_COMPACT_TYPE;
+		uint32_t hasResult = (layout & KRAFIX_SPIRV_COMPACT_RESULT) >> 1;
+		uint32_t firstId = (layout >> 8) & 0xff;
+		uint32_t idCount = (layout >> 16) & 0xff;
+		uint32_t result = 0;
+
+		for (uint32_t operand = 0; operand + 1 < wordCount; ++operand) {
+			uint32_t value = spirv[index + 1 + operand];
+			if (hasType && operand == 0) {
+				writeVarint(out, value);
+			}
+			else if (hasResult && operand == hasType) {
+				writeVarint(out, zigzag(value, lastResult));
+				result = lastResult = value;
+			}
+			else {
+				uint32_t position = operand - hasType - hasResult;
+				if (idCount != 0 && position >= firstId && (idCount == 0xff || position < firstId + idCount)) {
+					writeVarint(out, zigzag(value, hasResult ? result : lastId));
+					if (!hasResult) lastId = value;
+				}
+				else {
+					writeVarint(out, value);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace krafix {
+	// Writes the compact encoding of a SPIR-V module, see SpirVCompact.h for the layout and the decoder
+	void compactSpirv(const std::vector<uint32_t>& spirv, std::vector<uint8_t>& out);
+}
@@ -0,0 +1,338 @@
+#include "SpirVModule.h"
+
+#include <SPIRV/spirv.hpp>
+
+#include <algorithm>
+#include <string.h>
+
+using namespace krafix;
+
+SpirVModule::SpirVModule(const std::vector<uint32_t>& spirv) {
+	for (unsigned i = 0; i < 5; ++i) {
+		header[i] = i < spirv.size() ? spirv[i] : 0;
+	}
+	unsigned wordCount = 1;
+	for (unsigned index = 5; index < spirv.size(); index += wordCount) {
+		wordCount = spirv[index] >> 16;
+		if (wordCount == 0 || index + wordCount > spirv.size()) break;
+		instructions.push_back(std::vector<uint32_t>(spirv.begin() + index, spirv.begin() + index + wordCount));
+	}
+}
+
+std::vector<uint32_t> SpirVModule::assemble() const {
+	std::vector<uint32_t> spirv(header, header + 5);
+	for (auto& instruction : instructions) {
+		spirv.insert(spirv.end(), instruction.begin(), instruction.end());
+	}
+	return spirv;
+}
+
+std::vector<uint32_t> SpirVModule::makeInstruction(uint32_t opcode, const std::vector<uint32_t>& operands) {
+	std::vector<uint32_t> instruction;
+	instruction.push_back((uint32_t)((operands.size() + 1) << 16) | opcode);
+	instruction.insert(instruction.end(), operands.begin(), operands.end());
+	return instruction;
+}
+
+bool SpirVModule::hasResult(uint32_t op) {
+	using namespace spv;
+	switch (op) {
+	case OpNop:
+	case OpSourceContinued:
+	case OpSource:
+	case OpSourceExtension:
+	case OpName:
+	case OpMemberName:
+	case OpLine:
+	case OpNoLine:
+	case OpModuleProcessed:
+	case OpExtension:
+	case OpMemoryModel:
+	case OpEntryPoint:
+	case OpExecutionMode:
+	case OpExecutionModeId:
+	case OpCapability:
+	case OpTypeForwardPointer:
+	case OpDecorate:
+	case OpDecorateId:
+	case OpMemberDecorate:
+	case OpGroupDecorate:
+	case OpGroupMemberDecorate:
+	case OpFunctionEnd:
+	case OpStore:
+	case OpCopyMemory:
+	case OpCopyMemorySized:
+	case OpImageWrite:
+	case OpEmitVertex:
+	case OpEndPrimitive:
+	case OpEmitStreamVertex:
+	case OpEndStreamPrimitive:
+	case OpControlBarrier:
+	case OpMemoryBarrier:
+	case OpMemoryNamedBarrier:
+	case OpAtomicStore:
+	case OpAtomicFlagClear:
+	case OpLoopMerge:
+	case OpSelectionMerge:
+	case OpBranch:
+	case OpBranchConditional:
+	case OpSwitch:
+	case OpKill:
+	case OpReturn:
+	case OpReturnValue:
+	case OpUnreachable:
+	case OpLifetimeStart:
+	case OpLifetimeStop:
+		return false;
+	default:
+		return true;
+	}
+}
+
+uint32_t SpirVModule::resultId(const std::vector<uint32_t>& instruction) {
+	using namespace spv;
+	uint32_t op = opcode(instruction);
+	if (!hasResult(op)) return 0;
+	size_t word = (op == OpLabel || op == OpExtInstImport || op == OpString || op == OpDecorationGroup) ? 1 : 2;
+	return word < instruction.size() ? instruction[word] : 0;
+}
+
+std::vector<size_t> SpirVModule::idOperands(const std::vector<uint32_t>& instruction) {
+	using namespace spv;
+	uint32_t op = opcode(instruction);
+	size_t first = 1;
+	if (hasResult(op)) first = (op == OpLabel || op == OpExtInstImport || op == OpString || op == OpDecorationGroup) ? 2 : 3;
+	// Words from end on and the word at literal are literals
+	size_t end = instruction.size();
+	size_t literal = 0;
+	switch (op) {
+	case OpExtInst:
+		literal = 4;
+		break;
+	case OpVariable:
+	case OpFunction:
+		literal = 3;
+		break;
+	case OpLoad:
+	case OpCompositeExtract:
+	case OpBranchConditional:
+	case OpCopyMemorySized:
+		end = 4;
+		break;
+	case OpStore:
+	case OpCopyMemory:
+	case OpLoopMerge:
+		end = 3;
+		break;
+	case OpCompositeInsert:
+	case OpVectorShuffle:
+		end = 5;
+		break;
+	case OpSelectionMerge:
+	case OpLine:
+		end = 2;
+		break;
+	case OpImageSampleImplicitLod:
+	case OpImageSampleExplicitLod:
+	case OpImageSampleProjImplicitLod:
+	case OpImageSampleProjExplicitLod:
+	case OpImageFetch:
+	case OpImageRead:
+	case OpImageSparseSampleImplicitLod:
+	case OpImageSparseSampleExplicitLod:
+	case OpImageSparseSampleProjImplicitLod:
+	case OpImageSparseSampleProjExplicitLod:
+	case OpImageSparseFetch:
+	case OpImageSparseRead:
+		literal = 5;
+		break;
+	case OpImageSampleDrefImplicitLod:
+	case OpImageSampleDrefExplicitLod:
+	case OpImageSampleProjDrefImplicitLod:
+	case OpImageSampleProjDrefExplicitLod:
+	case OpImageGather:
+	case OpImageDrefGather:
+	case OpImageSparseSampleDrefImplicitLod:
+	case OpImageSparseSampleDrefExplicitLod:
+	case OpImageSparseSampleProjDrefImplicitLod:
+	case OpImageSparseSampleProjDrefExplicitLod:
+	case OpImageSparseGather:
+	case OpImageSparseDrefGather:
+		literal = 6;
+		break;
+	case OpImageWrite:
+		literal = 4;
+		break;
+	default:
+		// Group operations take the execution scope id and then the literal operation
+		if ((op >= OpGroupIAdd && op <= OpGroupSMax) || (op >= OpGroupNonUniformIAdd && op <= OpGroupNonUniformLogicalXor) || op == OpGroupNonUniformBallotBitCount) {
+			literal = 4;
+		}
+		break;
+	}
+
+	std::vector<size_t> ids;
+	for (size_t word = first; word < end; ++word) {
+		// Switch targets alternate with 32 bit literals behind the selector and the default label
+		if (op == OpSwitch && word > 2 && (word - 3) % 2 == 0) continue;
+		if (word != literal) ids.push_back(word);
+	}
+	return ids;
+}
+
+std::map<uint32_t, std::string> SpirVModule::names() const {
+	std::map<uint32_t, std::string> names;
+	for (auto& instruction : instructions) {
+		if (opcode(instruction) == spv::OpName && instruction.size() > 2) {
+			names[instruction[1]] = (const char*)&instruction[2];
+		}
+	}
+	return names;
+}
+
+bool SpirVModule::hasDecoration(uint32_t id, uint32_t decoration) const {
+	for (auto& instruction : instructions) {
+		if (opcode(instruction) == spv::OpDecorate && instruction.size() > 2 && instruction[1] == id && instruction[2] == decoration) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void SpirVModule::removeDecorations(uint32_t id, const std::vector<uint32_t>& decorations) {
+	instructions.erase(std::remove_if(instructions.begin(), instructions.end(), [id, &decorations](const std::vector<uint32_t>& instruction) {
+		return opcode(instruction) == spv::OpDecorate && instruction.size() > 2 && instruction[1] == id
+			&& std::find(decorations.begin(), decorations.end(), instruction[2]) != decorations.end();
+	}), instructions.end());
+}
+
+void SpirVModule::removeFromInterface(uint32_t id) {
+	for (auto& instruction : instructions) {
+		if (opcode(instruction) != spv::OpEntryPoint) continue;
+		// execution model, entry point id and the literal name precede the interface ids
+		size_t nameWords = strlen((const char*)&instruction[3]) / 4 + 1;
+		auto interfaceStart = instruction.begin() + 3 + nameWords;
+		instruction.erase(std::remove(interfaceStart, instruction.end(), id), instruction.end());
+		instruction[0] = (uint32_t)(instruction.size() << 16) | spv::OpEntryPoint;
+	}
+}
+
+void SpirVModule::addToInterface(uint32_t id) {
+	for (auto& instruction : instructions) {
+		if (opcode(instruction) != spv::OpEntryPoint) continue;
+		instruction.push_back(id);
+		instruction[0] = (uint32_t)(instruction.size() << 16) | spv::OpEntryPoint;
+	}
+}
+
+void SpirVModule::appendString(std::vector<uint32_t>& operands, const std::string& text) {
+	for (size_t i = 0; i <= text.size(); i += 4) {
+		uint32_t word = 0;
+		for (size_t j = 0; j < 4 && i + j < text.size(); ++j) {
+			word |= (uint32_t)(uint8_t)text[i + j] << (j * 8);
+		}
+		operands.push_back(word);
+	}
+}
+
+void SpirVModule::addName(uint32_t id, const std::string& name) {
+	std::vector<uint32_t> operands;
+	operands.push_back(id);
+	appendString(operands, name);
+	addDebugInstruction(makeInstruction(spv::OpName, operands));
+}
+
+void SpirVModule::addMemberName(uint32_t type, uint32_t member, const std::string& name) {
+	std::vector<uint32_t> operands;
+	operands.push_back(type);
+	operands.push_back(member);
+	appendString(operands, name);
+	addDebugInstruction(makeInstruction(spv::OpMemberName, operands));
+}
+
+void SpirVModule::addDebugInstruction(const std::vector<uint32_t>& instruction) {
+	// Names go behind the other debug instructions, in front of the annotations
+	size_t position = 0;
+	for (size_t i = 0; i < instructions.size(); ++i) {
+		uint32_t op = opcode(instructions[i]);
+		if (op == spv::OpName || op == spv::OpMemberName || op == spv::OpString || op == spv::OpSource || op == spv::OpSourceExtension
+			|| op == spv::OpSourceContinued || op == spv::OpEntryPoint || op == spv::OpExecutionMode || op == spv::OpCapability
+			|| op == spv::OpExtension || op == spv::OpExtInstImport || op == spv::OpMemoryModel) {
+			position = i + 1;
+		}
+	}
+	instructions.insert(instructions.begin() + position, instruction);
+}
+
+void SpirVModule::addAnnotation(const std::vector<uint32_t>& instruction) {
+	// Annotations close the section in front of the types
+	size_t position = 0;
+	for (size_t i = 0; i < instructions.size(); ++i) {
+		uint32_t op = opcode(instructions[i]);
+		if ((op >= spv::OpTypeVoid && op <= spv::OpTypeForwardPointer) || op == spv::OpFunction) {
+			break;
+		}
+		if (op == spv::OpDecorate || op == spv::OpMemberDecorate || op == spv::OpDecorationGroup || op == spv::OpGroupDecorate
+			|| op == spv::OpGroupMemberDecorate || op == spv::OpName || op == spv::OpMemberName || op == spv::OpString || op == spv::OpSource
+			|| op == spv::OpSourceExtension || op == spv::OpSourceContinued || op == spv::OpEntryPoint || op == spv::OpExecutionMode
+			|| op == spv::OpCapability || op == spv::OpExtension || op == spv::OpExtInstImport || op == spv::OpMemoryModel) {
+			position = i + 1;
+		}
+	}
+	instructions.insert(instructions.begin() + position, instruction);
+}
+
+void SpirVModule::addGlobal(const std::vector<uint32_t>& instruction) {
+	for (size_t i = 0; i < instructions.size(); ++i) {
+		if (opcode(instructions[i]) == spv::OpFunction) {
+			instructions.insert(instructions.begin() + i, instruction);
+			return;
+		}
+	}
+	instructions.push_back(instruction);
+}
+
+const std::vector<uint32_t>* SpirVModule::findType(uint32_t id) const {
+	for (auto& instruction : instructions) {
+		uint32_t op = opcode(instruction);
+		if (op >= spv::OpTypeVoid && op <= spv::OpTypeForwardPointer && instruction.size() > 1 && instruction[1] == id) {
+			return &instruction;
+		}
+	}
+	return nullptr;
+}
+
+uint32_t SpirVModule::findOrAddVectorType(uint32_t componentType, uint32_t count) {
+	for (auto& instruction : instructions) {
+		if (opcode(instruction) == spv::OpTypeVector && instruction[2] == componentType && instruction[3] == count) {
+			return instruction[1];
+		}
+	}
+	const std::vector<uint32_t>* declaration = findType(componentType);
+	for (size_t i = 0; i < instructions.size(); ++i) {
+		if (&instructions[i] == declaration) {
+			uint32_t id = newId();
+			instructions.insert(instructions.begin() + i + 1, makeInstruction(spv::OpTypeVector, { id, componentType, count }));
+			return id;
+		}
+	}
+	return 0;
+}
+
+uint32_t SpirVModule::findOrAddPointerType(uint32_t storageClass, uint32_t type) {
+	for (auto& instruction : instructions) {
+		if (opcode(instruction) == spv::OpTypePointer && instruction[2] == storageClass && instruction[3] == type) {
+			return instruction[1];
+		}
+	}
+	// The pointer has to follow the pointee type's declaration
+	const std::vector<uint32_t>* declaration = findType(type);
+	for (size_t i = 0; i < instructions.size(); ++i) {
+		if (&instructions[i] == declaration) {
+			uint32_t id = newId();
+			instructions.insert(instructions.begin() + i + 1, makeInstruction(spv::OpTypePointer, { id, storageClass, type }));
+			return id;
+		}
+	}
+	return 0;
+}
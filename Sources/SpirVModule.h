@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace krafix {
+	// Editable copy of a SPIR-V module, every instruction keeps its own words including the opcode word.
+	class SpirVModule {
+	public:
+		SpirVModule(const std::vector<uint32_t>& spirv);
+		std::vector<uint32_t> assemble() const;
+
+		static uint32_t opcode(const std::vector<uint32_t>& instruction) { return instruction[0] & 0xffff; }
+		static std::vector<uint32_t> makeInstruction(uint32_t opcode, const std::vector<uint32_t>& operands);
+		static void appendString(std::vector<uint32_t>& operands, const std::string& text);
+		// Whether the instruction declares a result id
+		static bool hasResult(uint32_t opcode);
+		// The result id the instruction declares or 0
+		static uint32_t resultId(const std::vector<uint32_t>& instruction);
+		// Word indices of the id operands, without the result type and result id
+		static std::vector<size_t> idOperands(const std::vector<uint32_t>& instruction);
+
+		std::map<uint32_t, std::string> names() const;
+		bool hasDecoration(uint32_t id, uint32_t decoration) const;
+		void removeDecorations(uint32_t id, const std::vector<uint32_t>& decorations);
+		void removeFromInterface(uint32_t id);
+		void addToInterface(uint32_t id);
+		void addName(uint32_t id, const std::string& name);
+		void addMemberName(uint32_t type, uint32_t member, const std::string& name);
+		void addDebugInstruction(const std::vector<uint32_t>& instruction);
+		void addAnnotation(const std::vector<uint32_t>& instruction);
+		void addGlobal(const std::vector<uint32_t>& instruction);
+		const std::vector<uint32_t>* findType(uint32_t id) const;
+		uint32_t findOrAddVectorType(uint32_t componentType, uint32_t count);
+		uint32_t findOrAddPointerType(uint32_t storageClass, uint32_t type);
+		uint32_t newId() { return header[3]++; }
+
+		uint32_t header[5];
+		std::vector<std::vector<uint32_t>> instructions;
+	};
+}
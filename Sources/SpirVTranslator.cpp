@@ -1,12 +1,17 @@
 #include "SpirVTranslator.h"
+#include "Serialization.h"
+#include "SpirVCompactWriter.h"
+#include "VarListTranslator.h"
 
 #include <SPIRV/spirv.hpp>
 #include "../glslang/glslang/Public/ShaderLang.h"
 #include "../SPIRV-Cross/spirv_cross_error_handling.hpp"
 
 #include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <map>
+#include <set>
 #include <string.h>
 #include <sstream>
 #include <strstream>
@@ -204,8 +209,92 @@ namespace {
 	unsigned vec3arraytype = 0;
 	unsigned vec4arraytype = 0;
 
+	uint32_t uniformAlignment(unsigned utype) {
+		if (utype == booltype || utype == inttype || utype == floattype || utype == uinttype) return 4;
+		if (utype == vec2type) return 8;
+		if (utype == vec3type || utype == vec4type || utype == mat2type) return 16;
+		if (utype == mat3type) return 48;
+		if (utype == mat4type) return 64;
+		if (utype == floatarraytype || utype == vec2arraytype || utype == vec3arraytype || utype == vec4arraytype) return 16;
+		return 1;
+	}
+
+	uint32_t uniformEnd(uint32_t offset, unsigned utype, std::map<unsigned, unsigned>& arraySizes) {
+		if (utype == booltype || utype == inttype || utype == floattype || utype == uinttype) {
+			offset += 4;
+		}
+		else if (utype == vec2type) {
+			offset += 8;
+		}
+		else if (utype == vec3type) {
+			offset += 12;
+		}
+		else if (utype == vec4type) {
+			offset += 16;
+		}
+		else if (utype == mat2type) {
+			offset += 16;
+		}
+		else if (utype == mat3type) {
+			offset += 48; // 36 + 12 padding for DecorationMatrixStride of 16
+		}
+		else if (utype == mat4type) offset += 64;
+		else if (utype == floatarraytype) {
+			offset += arraySizes[floatarraytype] * 4;
+			if (offset % 8 != 0) {
+				offset += 4;
+			}
+		}
+		else if (utype == vec2arraytype) {
+			offset += arraySizes[vec2arraytype] * 4 * 2;
+		}
+		else if (utype == vec3arraytype) {
+			offset += arraySizes[vec3arraytype] * 4 * 3;
+			if (offset % 8 != 0) {
+				offset += 4;
+			}
+		}
+		else if (utype == vec4arraytype) {
+			offset += arraySizes[vec4arraytype] * 4 * 4;
+		}
+		else {
+			offset += 1; // Type not handled
+		}
+		return offset;
+	}
+
+	// Orders the members of the global uniform buffer by alignment (names break ties) and
+	// moves smaller members forward when they fit into the padding in front of the next one,
+	// for example a float directly behind a vec3.
+	void packUniforms(std::vector<Var>& uniforms, std::map<unsigned, unsigned>& pointers, std::map<unsigned, unsigned>& arraySizes) {
+		std::vector<Var> remaining = uniforms;
+		std::sort(remaining.begin(), remaining.end(), [&pointers](const Var& a, const Var& b) {
+			uint32_t aalign = uniformAlignment(pointers[a.type]);
+			uint32_t balign = uniformAlignment(pointers[b.type]);
+			if (aalign != balign) return aalign > balign;
+			return varcompare(a, b);
+		});
+
+		uniforms.clear();
+		uint32_t offset = 0;
+		while (remaining.size() > 0) {
+			size_t next = 0;
+			for (size_t i = 0; i < remaining.size(); ++i) {
+				if (alignOffset(offset, uniformAlignment(pointers[remaining[i].type])) == offset) {
+					next = i;
+					break;
+				}
+			}
+			unsigned utype = pointers[remaining[next].type];
+			offset = uniformEnd(alignOffset(offset, uniformAlignment(utype)), utype, arraySizes);
+			uniforms.push_back(remaining[next]);
+			remaining.erase(remaining.begin() + next);
+		}
+	}
+
 	void outputDecorations(unsigned* instructionsData, unsigned& instructionsDataIndex, std::vector<unsigned>& structtypeindices, std::vector<unsigned>& structidindices, std::vector<Instruction>& newinstructions, std::vector<Var>& uniforms,
-		std::map<unsigned, unsigned>& pointers, std::vector<Var>& invars, std::vector<Var>& outvars, std::vector<Var>& images, std::map<unsigned, unsigned> arraySizes, ShaderStage stage) {
+		std::map<unsigned, unsigned>& pointers, std::vector<Var>& invars, std::vector<Var>& outvars, std::vector<Var>& images, std::map<unsigned, unsigned> arraySizes, ShaderStage stage,
+		std::vector<UniformLayoutMember>& layout, const std::vector<DescriptorBinding>& descriptors) {
 
 		unsigned location = 0;
 		for (auto var : invars) {
@@ -227,12 +316,21 @@ namespace {
 		}
 		unsigned binding = 2;
 		for (auto var : images) {
+			const DescriptorBinding* descriptor = findDescriptor(descriptors, var.name, stage);
 			Instruction newinst(OpDecorate, &instructionsData[instructionsDataIndex], 3);
 			instructionsData[instructionsDataIndex++] = var.id;
 			instructionsData[instructionsDataIndex++] = DecorationBinding;
-			instructionsData[instructionsDataIndex++] = binding;
+			instructionsData[instructionsDataIndex++] = descriptor != nullptr ? descriptor->binding : binding;
 			newinstructions.push_back(newinst);
 			++binding;
+
+			if (descriptor != nullptr) {
+				Instruction decdescset(OpDecorate, &instructionsData[instructionsDataIndex], 3);
+				instructionsData[instructionsDataIndex++] = var.id;
+				instructionsData[instructionsDataIndex++] = DecorationDescriptorSet;
+				instructionsData[instructionsDataIndex++] = descriptor->set;
+				newinstructions.push_back(decdescset);
+			}
 		}
 		unsigned offset = 0;
 		for (unsigned i = 0; i < uniforms.size(); ++i) {
@@ -288,96 +386,46 @@ namespace {
 				newinstructions.push_back(dec3);
 			}
 
-			if (utype == booltype || utype == inttype || utype == floattype || utype == uinttype) {
-				offset = alignOffset(offset, 4);
-			}
-			else if (utype == vec2type) {
-				offset = alignOffset(offset, 8);
-			}
-			else if (utype == vec3type) {
-				offset = alignOffset(offset, 16);
-			}
-			else if (utype == vec4type) {
-				offset = alignOffset(offset, 16);
-			}
-			else if (utype == mat2type) {
-				offset = alignOffset(offset, 16);
-			}
-			else if (utype == mat3type) {
-				offset = alignOffset(offset, 48);
-			}
-			else if (utype == mat4type) {
-				offset = alignOffset(offset, 64);
-			}
-			else if (utype == floatarraytype) {
-				offset = alignOffset(offset, 16);
-			}
-			else if (utype == vec2arraytype) {
-				offset = alignOffset(offset, 16);
-			}
-			else if (utype == vec3arraytype) {
-				offset = alignOffset(offset, 16);
-			}
-			else if (utype == vec4arraytype) {
-				offset = alignOffset(offset, 16);
-			}
-			
+			offset = alignOffset(offset, uniformAlignment(utype));
 			*offsetPointer = offset;
 
-			if (utype == booltype || utype == inttype || utype == floattype || utype == uinttype) {
-				offset += 4;
-			}
-			else if (utype == vec2type) {
-				offset += 8;
-			}
-			else if (utype == vec3type) {
-				offset += 12;
-			}
-			else if (utype == vec4type) {
-				offset += 16;
-			}
-			else if (utype == mat2type) {
-				offset += 16;
-			}
-			else if (utype == mat3type) {
-				offset += 48; // 36 + 12 padding for DecorationMatrixStride of 16
+			UniformLayoutMember member;
+			member.name = uniforms[i].name;
+			member.offset = offset;
+			if (utype == mat2type || utype == mat3type || utype == mat4type) {
+				member.matrixStride = 16;
 			}
-			else if (utype == mat4type) offset += 64;
 			else if (utype == floatarraytype) {
-				offset += arraySizes[floatarraytype] * 4;
-				if (offset % 8 != 0) {
-					offset += 4;
-				}
+				member.arrayStride = 1 * 4;
 			}
 			else if (utype == vec2arraytype) {
-				offset += arraySizes[vec2arraytype] * 4 * 2;
+				member.arrayStride = 2 * 4;
 			}
 			else if (utype == vec3arraytype) {
-				offset += arraySizes[vec3arraytype] * 4 * 3;
-				if (offset % 8 != 0) {
-					offset += 4;
-				}
+				member.arrayStride = 3 * 4;
 			}
 			else if (utype == vec4arraytype) {
-				offset += arraySizes[vec4arraytype] * 4 * 4;
-			}
-			else {
-				offset += 1; // Type not handled
+				member.arrayStride = 4 * 4;
 			}
+			offset = uniformEnd(offset, utype, arraySizes);
+			member.size = offset - member.offset;
+			layout.push_back(member);
 		}
 		if (uniforms.size() > 0) {
+			const DescriptorBinding* descriptor = findDescriptor(descriptors, globalUniformBufferName, stage);
+
 			Instruction decbind(OpDecorate, &instructionsData[instructionsDataIndex], 3);
 			structidindices.push_back(instructionsDataIndex);
 			instructionsData[instructionsDataIndex++] = 0;
 			instructionsData[instructionsDataIndex++] = DecorationBinding;
-			instructionsData[instructionsDataIndex++] = stage == StageVertex ? 0 : 1;
+			instructionsData[instructionsDataIndex++] = descriptor != nullptr ? descriptor->binding : (stage == StageVertex ? 0 : 1);
 			newinstructions.push_back(decbind);
 
 			Instruction decdescset(OpDecorate, &instructionsData[instructionsDataIndex], 3);
 			structidindices.push_back(instructionsDataIndex);
 			instructionsData[instructionsDataIndex++] = 0;
 			instructionsData[instructionsDataIndex++] = DecorationDescriptorSet;
-			instructionsData[instructionsDataIndex++] = 0;
+			instructionsData[instructionsDataIndex++] = descriptor != nullptr ? descriptor->set : 0;
 			newinstructions.push_back(decdescset);
 
 			Instruction dec1(OpDecorate, &instructionsData[instructionsDataIndex], 2);
@@ -498,6 +546,143 @@ namespace {
 	}
 }
 
+namespace {
+	// Mirrors Optimizer::RegisterPerformancePasses so every pass can be run and measured on its own
+	const char* performancePasses[] = {
+		"--wrap-opkill",
+		"--eliminate-dead-branches",
+		"--merge-return",
+		"--inline-entry-points-exhaustive",
+		"--eliminate-dead-functions",
+		"--eliminate-dead-code-aggressive",
+		"--private-to-local",
+		"--eliminate-local-single-block",
+		"--eliminate-local-single-store",
+		"--eliminate-dead-code-aggressive",
+		"--scalar-replacement=100",
+		"--convert-local-access-chains",
+		"--eliminate-local-single-block",
+		"--eliminate-local-single-store",
+		"--eliminate-dead-code-aggressive",
+		"--ssa-rewrite",
+		"--eliminate-dead-code-aggressive",
+		"--ccp",
+		"--eliminate-dead-code-aggressive",
+		"--loop-unroll",
+		"--eliminate-dead-branches",
+		"--redundancy-elimination",
+		"--combine-access-chains",
+		"--simplify-instructions",
+		"--scalar-replacement=100",
+		"--convert-local-access-chains",
+		"--eliminate-local-single-block",
+		"--eliminate-local-single-store",
+		"--eliminate-dead-code-aggressive",
+		"--ssa-rewrite",
+		"--eliminate-dead-code-aggressive",
+		"--vector-dce",
+		"--eliminate-dead-inserts",
+		"--eliminate-dead-branches",
+		"--simplify-instructions",
+		"--if-conversion",
+		"--copy-propagate-arrays",
+		"--reduce-load-size",
+		"--eliminate-dead-code-aggressive",
+		"--merge-blocks",
+		"--redundancy-elimination",
+		"--eliminate-dead-branches",
+		"--merge-blocks",
+		"--simplify-instructions"
+	};
+
+	void writeOptimizerReport(const char* filename, const std::vector<uint32_t>& spirv, const std::vector<uint32_t>& optimizedSpirv, bool success, double milliseconds) {
+		std::ofstream out;
+		out.open(filename, std::ios::binary | std::ios::out);
+		out << "{\n";
+		out << "\t\"success\": " << (success ? "true" : "false") << ",\n";
+		out << "\t\"ms\": " << milliseconds << ",\n";
+		out << "\t\"input_words\": " << spirv.size() << ",\n";
+		out << "\t\"output_words\": " << (success ? optimizedSpirv.size() : spirv.size()) << ",\n";
+		out << "\t\"passes\": [\n";
+
+		// Validation is already covered by the full run above, only the passes themselves are timed
+		spvtools::OptimizerOptions options;
+		options.set_run_validator(false);
+
+		std::vector<uint32_t> current = spirv;
+		const unsigned passCount = sizeof(performancePasses) / sizeof(performancePasses[0]);
+		for (unsigned i = 0; i < passCount; ++i) {
+			std::string message;
+			spvtools::Optimizer optimizer(SPV_ENV_VULKAN_1_0);
+			optimizer.SetMessageConsumer([&message](spv_message_level_t, const char*, const spv_position_t&, const char* text) {
+				if (message.empty()) message = text;
+			});
+
+			out << "\t\t{ \"pass\": \"" << (performancePasses[i] + 2) << "\", ";
+			if (!optimizer.RegisterPassFromFlag(performancePasses[i])) {
+				out << "\"available\": false }";
+			}
+			else {
+				std::vector<uint32_t> result;
+				auto start = std::chrono::steady_clock::now();
+				bool passSuccess = optimizer.Run(current.data(), current.size(), &result, options);
+				double passMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				out << "\"ms\": " << passMilliseconds << ", \"input_words\": " << current.size() << ", ";
+				if (passSuccess) {
+					out << "\"output_words\": " << result.size() << ", \"changed\": " << (result != current ? "true" : "false") << ", \"success\": true }";
+					current.swap(result);
+				}
+				else {
+					out << "\"success\": false, \"error\": \"" << escapeJson(message) << "\" }";
+				}
+			}
+			if (i < passCount - 1) out << ",";
+			out << "\n";
+		}
+
+		out << "\t]\n";
+		out << "}\n";
+		out.close();
+	}
+}
+
+namespace {
+	// Removes everything the runtime does not look up by name. Kept are the names the binary reflection
+	// records, everything else goes to debug.
+	void stripDebugInformation(std::vector<uint32_t>& spirv, std::vector<uint32_t>& debug) {
+		ReflectedIds reflected = reflectedIds(spirv);
+
+		unsigned wordCount = 1;
+		debug.assign(spirv.begin(), spirv.begin() + 5);
+		std::vector<uint32_t> stripped(spirv.begin(), spirv.begin() + 5);
+		for (unsigned index = 5; index < spirv.size(); index += wordCount) {
+			wordCount = spirv[index] >> 16;
+			unsigned opcode = spirv[index] & 0xffff;
+			bool strip = false;
+			switch (opcode) {
+			case OpSource:
+			case OpSourceContinued:
+			case OpSourceExtension:
+			case OpString:
+			case OpLine:
+			case OpNoLine:
+			case OpModuleProcessed:
+				strip = true;
+				break;
+			case OpName:
+				strip = reflected.variables.find(spirv[index + 1]) == reflected.variables.end() && reflected.structs.find(spirv[index + 1]) == reflected.structs.end();
+				break;
+			case OpMemberName:
+				strip = reflected.structs.find(spirv[index + 1]) == reflected.structs.end();
+				break;
+			}
+			std::vector<uint32_t>& out = strip ? debug : stripped;
+			out.insert(out.end(), spirv.begin() + index, spirv.begin() + index + wordCount);
+		}
+		spirv.swap(stripped);
+	}
+}
+
 void SpirVTranslator::outputCode(const Target& target, const char* sourcefilename, const char* filename, char* output, std::map<std::string, int>& attributes) {
 	booltype = 0;
 	inttype = 0;
@@ -528,7 +713,7 @@ void SpirVTranslator::outputCode(const Target& target, const char* sourcefilenam
 	std::map<unsigned, unsigned> accessChains;
 	std::map<unsigned, unsigned> arraySizeConstants;
 	std::map<unsigned, unsigned> arraySizes;
-	unsigned position;
+	unsigned position = 0;
 
 	for (unsigned i = 0; i < instructions.size(); ++i) {
 		Instruction& inst = instructions[i];
@@ -634,7 +819,8 @@ void SpirVTranslator::outputCode(const Target& target, const char* sourcefilenam
 
 			break;
 		}
-		case OpConstant: {
+		case OpConstant:
+		case OpSpecConstant: {
 			unsigned id = inst.operands[1];
 			if (arraySizeConstants[id] == 0) {
 				arraySizeConstants[id] = inst.operands[2];
@@ -708,6 +894,10 @@ void SpirVTranslator::outputCode(const Target& target, const char* sourcefilenam
 	std::sort(invars.begin(), invars.end(), varcompare);
 	std::sort(outvars.begin(), outvars.end(), varcompare);
 	std::sort(images.begin(), images.end(), varcompare);
+	if (target.packUniforms) {
+		packUniforms(uniforms, pointers, arraySizes);
+	}
+	std::vector<UniformLayoutMember> uniformBufferMembers;
 
 	SpirVState state = SpirVStart;
 	std::vector<Instruction> newinstructions;
@@ -747,7 +937,7 @@ void SpirVTranslator::outputCode(const Target& target, const char* sourcefilenam
 					namesInserted = true;
 				}
 				if (!decorationsInserted) {
-					outputDecorations(instructionsData, instructionsDataIndex, structtypeindices, structidindices, newinstructions, uniforms, pointers, invars, outvars, images, arraySizes, stage);
+					outputDecorations(instructionsData, instructionsDataIndex, structtypeindices, structidindices, newinstructions, uniforms, pointers, invars, outvars, images, arraySizes, stage, uniformBufferMembers, descriptors);
 					decorationsInserted = true;
 				}
 			}
@@ -759,7 +949,7 @@ void SpirVTranslator::outputCode(const Target& target, const char* sourcefilenam
 					namesInserted = true;
 				}
 				if (!decorationsInserted) {
-					outputDecorations(instructionsData, instructionsDataIndex, structtypeindices, structidindices, newinstructions, uniforms, pointers, invars, outvars, images, arraySizes, stage);
+					outputDecorations(instructionsData, instructionsDataIndex, structtypeindices, structidindices, newinstructions, uniforms, pointers, invars, outvars, images, arraySizes, stage, uniformBufferMembers, descriptors);
 					decorationsInserted = true;
 				}
 			}
@@ -773,7 +963,7 @@ void SpirVTranslator::outputCode(const Target& target, const char* sourcefilenam
 					namesInserted = true;
 				}
 				if (!decorationsInserted) {
-					outputDecorations(instructionsData, instructionsDataIndex, structtypeindices, structidindices, newinstructions, uniforms, pointers, invars, outvars, images, arraySizes, stage);
+					outputDecorations(instructionsData, instructionsDataIndex, structtypeindices, structidindices, newinstructions, uniforms, pointers, invars, outvars, images, arraySizes, stage, uniformBufferMembers, descriptors);
 					decorationsInserted = true;
 				}
 			}
@@ -1065,7 +1255,7 @@ void SpirVTranslator::outputCode(const Target& target, const char* sourcefilenam
 				copy.operands[2] = BuiltInVertexIndex;
 				newinstructions.push_back(copy);
 			}
-			else if (decoration != DecorationBinding) {
+			else if (decoration != DecorationBinding && (decoration != DecorationDescriptorSet || descriptors.empty())) {
 				newinstructions.push_back(inst);
 			}
 		}
@@ -1076,21 +1266,68 @@ void SpirVTranslator::outputCode(const Target& target, const char* sourcefilenam
 
 	bound = currentId + 1;
 
+	uniformBlocks.clear();
+	if (uniformBufferMembers.size() > 0) {
+		UniformLayoutBlock block;
+		block.name = globalUniformBufferName;
+		const DescriptorBinding* descriptor = findDescriptor(descriptors, globalUniformBufferName, stage);
+		block.binding = descriptor != nullptr ? descriptor->binding : (stage == StageVertex ? 0 : 1);
+		block.members = uniformBufferMembers;
+		block.size = block.members.back().offset + block.members.back().size;
+		uniformBlocks.push_back(block);
+	}
+
 	//outputLength = writeInstructions(filename, output, newinstructions);
 
 	std::vector<uint32_t> spirv;
 	outputLength = writeInstructions(spirv, newinstructions);
 
 	spvtools::Optimizer optimizer(SPV_ENV_VULKAN_1_0);
+	std::string optimizerMessage;
+	optimizer.SetMessageConsumer([&optimizerMessage](spv_message_level_t, const char*, const spv_position_t&, const char* text) {
+		if (optimizerMessage.empty()) optimizerMessage = text;
+	});
 	optimizer.RegisterPerformancePasses();
 	std::vector<uint32_t> optimizedSpirv;
+	auto start = std::chrono::steady_clock::now();
 	bool success = optimizer.Run(spirv.data(), spirv.size(), &optimizedSpirv);
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	if (target.spirvOptReport && !output) {
+		writeOptimizerReport((std::string(filename) + ".optreport.json").c_str(), spirv, optimizedSpirv, success, milliseconds);
+	}
 
 	if (!success) {
 		fprintf(stderr, "Optimizer error, falling back to unoptimized SPIRV.\n");
+		if (!optimizerMessage.empty()) fprintf(stderr, "%s\n", optimizerMessage.c_str());
 		optimizedSpirv = spirv;
 	}
 	
+	if (target.spirvStripDebug) {
+		std::vector<uint32_t> debug;
+		stripDebugInformation(optimizedSpirv, debug);
+		if (!output) {
+			FILE* file = fopen((std::string(filename) + ".debug").c_str(), "wb");
+			fwrite(debug.data(), 4, debug.size(), file);
+			fclose(file);
+		}
+	}
+
+	if (target.spirvCompact) {
+		std::vector<uint8_t> compact;
+		compactSpirv(optimizedSpirv, compact);
+		outputLength = (int)compact.size();
+		if (output) {
+			memcpy(output, compact.data(), outputLength);
+		}
+		else {
+			FILE* file = fopen(filename, "wb");
+			fwrite(compact.data(), 1, compact.size(), file);
+			fclose(file);
+		}
+		return;
+	}
+
 	outputLength = (int)(optimizedSpirv.size() * 4);
 	if (output) {
 		memcpy(output, optimizedSpirv.data(), outputLength);
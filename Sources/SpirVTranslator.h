@@ -1,6 +1,8 @@
 #pragma once
 
+#include "DescriptorPlan.h"
 #include "Translator.h"
+#include "UniformLayout.h"
 
 #include <cstdint>
 
@@ -10,6 +12,9 @@ namespace krafix {
 		SpirVTranslator(std::vector<unsigned>& spirv, ShaderStage stage) : Translator(spirv, stage) {}
 		void outputCode(const Target& target, const char* sourcefilename, const char* filename, char* output, std::map<std::string, int>& attributes) override;
 		int outputLength;
+		std::vector<UniformLayoutBlock> uniformBlocks;
+		// Descriptor sets and bindings to use instead of the fixed layout when not empty
+		std::vector<DescriptorBinding> descriptors;
 	private:
 		int writeInstructions(const char* filename, char* output, std::vector<Instruction>& instructions);
 		int writeInstructions(std::vector<uint32_t>& output, std::vector<Instruction>& instructions);
@@ -0,0 +1,325 @@
+#include "StageInterface.h"
+#include "SpirVModule.h"
+
+#include <SPIRV/spirv.hpp>
+#include <spirv-tools/optimizer.hpp>
+
+#include <algorithm>
+#include <set>
+
+using namespace krafix;
+
+namespace {
+	using namespace spv;
+
+	std::set<std::string> inputNames(const std::vector<uint32_t>& spirv) {
+		SpirVModule module(spirv);
+		std::map<uint32_t, std::string> names = module.names();
+		std::set<std::string> inputs;
+		for (auto& instruction : module.instructions) {
+			if (SpirVModule::opcode(instruction) == OpVariable && instruction[3] == StorageClassInput && names.find(instruction[2]) != names.end()) {
+				inputs.insert(names[instruction[2]]);
+			}
+		}
+		return inputs;
+	}
+
+	std::vector<uint32_t>* findResult(SpirVModule& module, uint32_t id) {
+		for (auto& instruction : module.instructions) {
+			uint32_t op = SpirVModule::opcode(instruction);
+			if ((op == OpVariable || op == OpAccessChain || op == OpInBoundsAccessChain) && instruction[2] == id) {
+				return &instruction;
+			}
+		}
+		return nullptr;
+	}
+
+	// Turns interface variables into private variables, access chains into them have to point to private memory, too
+	void makePrivate(SpirVModule& module, const std::set<uint32_t>& variables) {
+		std::map<uint32_t, uint32_t> pointees;
+		std::set<uint32_t> pointers(variables.begin(), variables.end());
+		std::vector<uint32_t> accessChains;
+		for (auto& instruction : module.instructions) {
+			uint32_t op = SpirVModule::opcode(instruction);
+			if (op == OpTypePointer) {
+				pointees[instruction[1]] = instruction[3];
+			}
+			else if ((op == OpAccessChain || op == OpInBoundsAccessChain) && pointers.find(instruction[3]) != pointers.end()) {
+				pointers.insert(instruction[2]);
+				accessChains.push_back(instruction[2]);
+			}
+		}
+
+		const std::vector<uint32_t> interpolationDecorations = { DecorationLocation, DecorationComponent, DecorationIndex, DecorationFlat, DecorationNoPerspective,
+			DecorationCentroid, DecorationSample, DecorationPatch, DecorationInvariant };
+
+		for (auto id : variables) {
+			uint32_t privatePointer = module.findOrAddPointerType(StorageClassPrivate, pointees[findResult(module, id)->at(1)]);
+			std::vector<uint32_t>* variable = findResult(module, id);
+			(*variable)[1] = privatePointer;
+			(*variable)[3] = StorageClassPrivate;
+			module.removeDecorations(id, interpolationDecorations);
+			module.removeFromInterface(id);
+		}
+		for (auto id : accessChains) {
+			uint32_t privatePointer = module.findOrAddPointerType(StorageClassPrivate, pointees[findResult(module, id)->at(1)]);
+			(*findResult(module, id))[1] = privatePointer;
+		}
+	}
+
+	struct InterfaceVariable {
+		uint32_t id;
+		uint32_t type;
+	};
+
+	struct Varying {
+		std::string name;
+		uint32_t components;
+		uint32_t offset;
+	};
+
+	// Named, non builtin variables of a storage class by name
+	std::map<std::string, InterfaceVariable> interfaceVariables(const SpirVModule& module, uint32_t storageClass) {
+		std::map<uint32_t, std::string> names = module.names();
+		std::map<uint32_t, uint32_t> pointees;
+		std::map<std::string, InterfaceVariable> variables;
+		for (auto& instruction : module.instructions) {
+			uint32_t op = SpirVModule::opcode(instruction);
+			if (op == OpTypePointer) {
+				pointees[instruction[1]] = instruction[3];
+			}
+			else if (op == OpVariable && instruction[3] == storageClass) {
+				uint32_t id = instruction[2];
+				if (names.find(id) == names.end() || names[id] == "" || names[id].substr(0, 3) == "gl_" || module.hasDecoration(id, DecorationBuiltIn)) {
+					continue;
+				}
+				InterfaceVariable variable;
+				variable.id = id;
+				variable.type = pointees[instruction[1]];
+				variables[names[id]] = variable;
+			}
+		}
+		return variables;
+	}
+
+	// Component count of 32 bit float scalars and vectors, 0 for all other types
+	uint32_t floatComponents(const SpirVModule& module, uint32_t type, uint32_t& floatType) {
+		const std::vector<uint32_t>* declaration = module.findType(type);
+		if (declaration == nullptr) return 0;
+		uint32_t op = SpirVModule::opcode(*declaration);
+		if (op == OpTypeFloat && (*declaration)[2] == 32) {
+			floatType = type;
+			return 1;
+		}
+		if (op == OpTypeVector && floatComponents(module, (*declaration)[2], floatType) == 1) {
+			return (*declaration)[3];
+		}
+		return 0;
+	}
+
+	bool interpolatedSmoothly(const SpirVModule& module, uint32_t id) {
+		return !module.hasDecoration(id, DecorationFlat) && !module.hasDecoration(id, DecorationNoPerspective)
+			&& !module.hasDecoration(id, DecorationCentroid) && !module.hasDecoration(id, DecorationSample);
+	}
+
+	void writePackedVaryings(SpirVModule& module, const std::vector<std::vector<Varying>>& bins, std::map<std::string, InterfaceVariable>& variables, bool producer) {
+		uint32_t floatType = 0;
+		floatComponents(module, variables[bins[0][0].name].type, floatType);
+		uint32_t vec4Type = module.findOrAddVectorType(floatType, 4);
+		uint32_t storageClass = producer ? StorageClassOutput : StorageClassInput;
+		uint32_t pointerType = module.findOrAddPointerType(storageClass, vec4Type);
+
+		std::set<uint32_t> originals;
+		std::vector<uint32_t> packedIds;
+		bool padded = false;
+		for (size_t i = 0; i < bins.size(); ++i) {
+			uint32_t id = module.newId();
+			module.addGlobal(SpirVModule::makeInstruction(OpVariable, { pointerType, id, storageClass }));
+			module.addName(id, "_kfx_packed" + std::to_string(i));
+			module.addToInterface(id);
+			packedIds.push_back(id);
+			uint32_t components = 0;
+			for (auto& varying : bins[i]) {
+				originals.insert(variables[varying.name].id);
+				components += varying.components;
+			}
+			if (components < 4) padded = true;
+		}
+		makePrivate(module, originals);
+
+		uint32_t zero = 0;
+		if (producer && padded) {
+			zero = module.newId();
+			module.addGlobal(SpirVModule::makeInstruction(OpConstant, { floatType, zero, 0 }));
+		}
+
+		uint32_t entryPoint = 0;
+		for (auto& instruction : module.instructions) {
+			if (SpirVModule::opcode(instruction) == OpEntryPoint) entryPoint = instruction[2];
+		}
+		size_t functionStart = module.instructions.size();
+		size_t functionEnd = module.instructions.size();
+		for (size_t i = 0; i < module.instructions.size(); ++i) {
+			uint32_t op = SpirVModule::opcode(module.instructions[i]);
+			if (op == OpFunction && module.instructions[i][2] == entryPoint) functionStart = i;
+			if (op == OpFunctionEnd && i > functionStart && functionEnd == module.instructions.size()) functionEnd = i;
+		}
+		if (functionStart == module.instructions.size()) return;
+
+		if (producer) {
+			// Copy into the packed varyings right before every return of the entry point
+			for (size_t i = functionEnd; i > functionStart; --i) {
+				if (SpirVModule::opcode(module.instructions[i]) != OpReturn) continue;
+				std::vector<std::vector<uint32_t>> code;
+				for (size_t bin = 0; bin < bins.size(); ++bin) {
+					std::vector<uint32_t> operands = { vec4Type, 0 };
+					uint32_t components = 0;
+					for (auto& varying : bins[bin]) {
+						uint32_t value = module.newId();
+						code.push_back(SpirVModule::makeInstruction(OpLoad, { variables[varying.name].type, value, variables[varying.name].id }));
+						operands.push_back(value);
+						components += varying.components;
+					}
+					for (; components < 4; ++components) {
+						operands.push_back(zero);
+					}
+					operands[1] = module.newId();
+					code.push_back(SpirVModule::makeInstruction(OpCompositeConstruct, operands));
+					code.push_back(SpirVModule::makeInstruction(OpStore, { packedIds[bin], operands[1] }));
+				}
+				module.instructions.insert(module.instructions.begin() + i, code.begin(), code.end());
+			}
+		}
+		else {
+			// Unpack at the start of the entry point, behind the function's local variables
+			size_t position = functionStart + 1;
+			while (position < functionEnd && SpirVModule::opcode(module.instructions[position]) != OpLabel) ++position;
+			++position;
+			while (position < functionEnd && SpirVModule::opcode(module.instructions[position]) == OpVariable) ++position;
+			std::vector<std::vector<uint32_t>> code;
+			for (size_t bin = 0; bin < bins.size(); ++bin) {
+				uint32_t packed = module.newId();
+				code.push_back(SpirVModule::makeInstruction(OpLoad, { vec4Type, packed, packedIds[bin] }));
+				for (auto& varying : bins[bin]) {
+					uint32_t value = module.newId();
+					if (varying.components == 1) {
+						code.push_back(SpirVModule::makeInstruction(OpCompositeExtract, { floatType, value, packed, varying.offset }));
+					}
+					else {
+						std::vector<uint32_t> operands = { variables[varying.name].type, value, packed, packed };
+						for (uint32_t component = 0; component < varying.components; ++component) {
+							operands.push_back(varying.offset + component);
+						}
+						code.push_back(SpirVModule::makeInstruction(OpVectorShuffle, operands));
+					}
+					code.push_back(SpirVModule::makeInstruction(OpStore, { variables[varying.name].id, value }));
+				}
+			}
+			module.instructions.insert(module.instructions.begin() + position, code.begin(), code.end());
+		}
+	}
+}
+
+std::vector<std::string> krafix::trimUnusedVaryings(std::vector<uint32_t>& producer, const std::vector<uint32_t>& consumer) {
+	std::set<std::string> inputs = inputNames(consumer);
+	SpirVModule module(producer);
+	std::map<uint32_t, std::string> names = module.names();
+
+	std::vector<std::string> removed;
+	std::set<uint32_t> variables;
+	for (auto& instruction : module.instructions) {
+		uint32_t op = SpirVModule::opcode(instruction);
+		if (op == OpVariable && instruction[3] == StorageClassOutput) {
+			uint32_t id = instruction[2];
+			if (names.find(id) == names.end() || names[id] == "" || names[id].substr(0, 3) == "gl_" || module.hasDecoration(id, DecorationBuiltIn)) {
+				continue;
+			}
+			if (inputs.find(names[id]) == inputs.end()) {
+				variables.insert(id);
+				removed.push_back(names[id]);
+			}
+		}
+	}
+
+	if (variables.empty()) {
+		return removed;
+	}
+
+	makePrivate(module, variables);
+
+	std::vector<uint32_t> edited = module.assemble();
+
+	// The now private variables are only written, dead code elimination removes them and everything feeding them
+	spvtools::Optimizer optimizer(SPV_ENV_UNIVERSAL_1_0);
+	optimizer.RegisterPass(spvtools::CreatePrivateToLocalPass());
+	optimizer.RegisterPass(spvtools::CreateAggressiveDCEPass());
+	optimizer.RegisterPass(spvtools::CreateDeadVariableEliminationPass());
+	spvtools::OptimizerOptions options;
+	options.set_run_validator(false);
+	std::vector<uint32_t> optimized;
+	if (optimizer.Run(edited.data(), edited.size(), &optimized, options)) {
+		producer = optimized;
+	}
+	else {
+		producer = edited;
+	}
+
+	return removed;
+}
+
+std::vector<std::string> krafix::packVaryings(std::vector<uint32_t>& producer, std::vector<uint32_t>& consumer) {
+	SpirVModule producerModule(producer);
+	SpirVModule consumerModule(consumer);
+	std::map<std::string, InterfaceVariable> outputs = interfaceVariables(producerModule, StorageClassOutput);
+	std::map<std::string, InterfaceVariable> inputs = interfaceVariables(consumerModule, StorageClassInput);
+
+	std::vector<Varying> candidates;
+	for (auto& output : outputs) {
+		auto input = inputs.find(output.first);
+		if (input == inputs.end()) continue;
+		uint32_t floatType = 0;
+		uint32_t components = floatComponents(producerModule, output.second.type, floatType);
+		if (components == 0 || components == 4 || floatComponents(consumerModule, input->second.type, floatType) != components) continue;
+		if (!interpolatedSmoothly(producerModule, output.second.id) || !interpolatedSmoothly(consumerModule, input->second.id)) continue;
+		Varying varying;
+		varying.name = output.first;
+		varying.components = components;
+		varying.offset = 0;
+		candidates.push_back(varying);
+	}
+
+	// First fit decreasing, names break ties so both stages and repeated runs agree
+	std::stable_sort(candidates.begin(), candidates.end(), [](const Varying& a, const Varying& b) { return a.components > b.components; });
+	std::vector<std::vector<Varying>> bins;
+	std::vector<uint32_t> used;
+	for (auto varying : candidates) {
+		size_t bin = 0;
+		while (bin < bins.size() && used[bin] + varying.components > 4) ++bin;
+		if (bin == bins.size()) {
+			bins.push_back(std::vector<Varying>());
+			used.push_back(0);
+		}
+		varying.offset = used[bin];
+		used[bin] += varying.components;
+		bins[bin].push_back(varying);
+	}
+	bins.erase(std::remove_if(bins.begin(), bins.end(), [](const std::vector<Varying>& bin) { return bin.size() < 2; }), bins.end());
+
+	std::vector<std::string> packed;
+	if (bins.empty()) {
+		return packed;
+	}
+
+	writePackedVaryings(producerModule, bins, outputs, true);
+	writePackedVaryings(consumerModule, bins, inputs, false);
+	producer = producerModule.assemble();
+	consumer = consumerModule.assemble();
+
+	const char* swizzle = "xyzw";
+	for (size_t bin = 0; bin < bins.size(); ++bin) {
+		for (auto& varying : bins[bin]) {
+			packed.push_back(varying.name + ":_kfx_packed" + std::to_string(bin) + "." + std::string(&swizzle[varying.offset], varying.components));
+		}
+	}
+	return packed;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace krafix {
+	// Turns outputs of the producing stage which the consuming stage does not read into private
+	// variables and removes them together with the code that computes them. Varyings are matched
+	// by name. Returns the names of the removed outputs.
+	std::vector<std::string> trimUnusedVaryings(std::vector<uint32_t>& producer, const std::vector<uint32_t>& consumer);
+
+	// Packs smoothly interpolated float, vec2 and vec3 varyings of a linked stage pair into shared vec4
+	// varyings named _kfx_packedN. The original variables become private variables which are copied
+	// to the packed ones before the producer returns and from them when the consumer starts.
+	// Returns one "name:_kfx_packedN.components" entry per packed varying.
+	std::vector<std::string> packVaryings(std::vector<uint32_t>& producer, std::vector<uint32_t>& consumer);
+}
@@ -45,6 +45,13 @@ namespace krafix {
 		int version;
 		bool es;
 		TargetSystem system;
+		bool spirvOptReport = false;
+		bool spirvCompact = false;
+		bool spirvStripDebug = false;
+		bool packUniforms = false;
+		bool uniformBlocks = false;
+		bool minify = false;
+		bool autoPrecision = false;
 
 		std::string string() {
 			switch (lang) {
@@ -0,0 +1,280 @@
+#include "UniformBlock.h"
+#include "SpirVModule.h"
+
+#include <SPIRV/spirv.hpp>
+
+#include <algorithm>
+#include <set>
+
+using namespace krafix;
+
+namespace {
+	using namespace spv;
+
+	struct TypeLayout {
+		uint32_t size = 0;
+		uint32_t alignment = 0;
+		uint32_t arrayStride = 0;
+		uint32_t matrixStride = 0;
+	};
+
+	uint32_t alignTo(uint32_t offset, uint32_t alignment) {
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	class Std140 {
+	public:
+		Std140(SpirVModule& module) : module(&module) {
+			for (auto& instruction : module.instructions) {
+				if (SpirVModule::opcode(instruction) == OpConstant) constants[instruction[2]] = instruction[3];
+			}
+		}
+
+		// Collects the decorations std140 needs for nested arrays and structs, fails for types blocks can not hold
+		bool layout(uint32_t type, TypeLayout& result) {
+			const std::vector<uint32_t>* declaration = module->findType(type);
+			if (declaration == nullptr) return false;
+			switch (SpirVModule::opcode(*declaration)) {
+			case OpTypeInt:
+			case OpTypeFloat:
+				if ((*declaration)[2] != 32) return false;
+				result.size = result.alignment = 4;
+				return true;
+			case OpTypeVector: {
+				uint32_t count = (*declaration)[3];
+				TypeLayout component;
+				if (!layout((*declaration)[2], component)) return false;
+				result.size = count * 4;
+				result.alignment = count == 2 ? 8 : 16;
+				return true;
+			}
+			case OpTypeMatrix: {
+				TypeLayout column;
+				if (!layout((*declaration)[2], column)) return false;
+				result.matrixStride = 16;
+				result.size = (*declaration)[3] * 16;
+				result.alignment = 16;
+				return true;
+			}
+			case OpTypeArray: {
+				TypeLayout element;
+				if (!layout((*declaration)[2], element)) return false;
+				// Specialization could change the length and with it every following offset
+				auto length = constants.find((*declaration)[3]);
+				if (length == constants.end()) return false;
+				result.arrayStride = alignTo(element.size, 16);
+				result.matrixStride = element.matrixStride;
+				result.size = result.arrayStride * length->second;
+				result.alignment = 16;
+				if (decorated.insert(type).second && !module->hasDecoration(type, DecorationArrayStride)) {
+					annotations.push_back(SpirVModule::makeInstruction(OpDecorate, { type, DecorationArrayStride, result.arrayStride }));
+				}
+				return true;
+			}
+			case OpTypeStruct: {
+				std::vector<uint32_t> members(declaration->begin() + 2, declaration->end());
+				bool decorate = decorated.insert(type).second;
+				uint32_t offset = 0;
+				uint32_t alignment = 16;
+				for (uint32_t i = 0; i < members.size(); ++i) {
+					TypeLayout member;
+					if (!layout(members[i], member)) return false;
+					offset = alignTo(offset, member.alignment);
+					if (decorate) decorateMember(type, i, offset, member);
+					offset += member.size;
+					alignment = std::max(alignment, member.alignment);
+				}
+				result.size = alignTo(offset, alignment);
+				result.alignment = alignment;
+				return true;
+			}
+			default:
+				return false;
+			}
+		}
+
+		void decorateMember(uint32_t structType, uint32_t member, uint32_t offset, const TypeLayout& layout) {
+			annotations.push_back(SpirVModule::makeInstruction(OpMemberDecorate, { structType, member, DecorationOffset, offset }));
+			if (layout.matrixStride != 0) {
+				annotations.push_back(SpirVModule::makeInstruction(OpMemberDecorate, { structType, member, DecorationColMajor }));
+				annotations.push_back(SpirVModule::makeInstruction(OpMemberDecorate, { structType, member, DecorationMatrixStride, layout.matrixStride }));
+			}
+		}
+
+		std::vector<std::vector<uint32_t>> annotations;
+
+	private:
+		SpirVModule* module;
+		std::map<uint32_t, uint32_t> constants;
+		std::set<uint32_t> decorated;
+	};
+
+	struct Uniform {
+		uint32_t id;
+		uint32_t type;
+		std::string name;
+	};
+
+	uint32_t findOrAddIntType(SpirVModule& module) {
+		for (auto& instruction : module.instructions) {
+			if (SpirVModule::opcode(instruction) == OpTypeInt && instruction[2] == 32 && instruction[3] == 1) return instruction[1];
+		}
+		uint32_t id = module.newId();
+		module.addGlobal(SpirVModule::makeInstruction(OpTypeInt, { id, 32, 1 }));
+		return id;
+	}
+}
+
+bool krafix::wrapUniformsInBlock(std::vector<uint32_t>& spirv, const std::string& blockName, const std::string& instanceName, UniformLayoutBlock& layout) {
+	SpirVModule module(spirv);
+	std::map<uint32_t, std::string> names = module.names();
+	std::map<uint32_t, uint32_t> pointees;
+	std::vector<Uniform> uniforms;
+	for (auto& instruction : module.instructions) {
+		uint32_t op = SpirVModule::opcode(instruction);
+		if (op == OpTypePointer) {
+			pointees[instruction[1]] = instruction[3];
+		}
+		else if (op == OpVariable && instruction[3] == StorageClassUniformConstant && instruction.size() == 4 && names[instruction[2]] != ""
+			&& names[instruction[2]].substr(0, 3) != "gl_") {
+			Uniform uniform;
+			uniform.id = instruction[2];
+			uniform.type = pointees[instruction[1]];
+			uniform.name = names[uniform.id];
+			uniforms.push_back(uniform);
+		}
+	}
+	std::sort(uniforms.begin(), uniforms.end(), [](const Uniform& a, const Uniform& b) { return a.name < b.name; });
+
+	// Opaque types and bools fail the layout and stay where they are
+	Std140 std140(module);
+	std::vector<Uniform> members;
+	std::vector<TypeLayout> memberLayouts;
+	for (auto& uniform : uniforms) {
+		TypeLayout typeLayout;
+		Std140 backup = std140;
+		if (std140.layout(uniform.type, typeLayout)) {
+			members.push_back(uniform);
+			memberLayouts.push_back(typeLayout);
+		}
+		else {
+			std140 = backup;
+		}
+	}
+	if (members.empty()) return false;
+
+	uint32_t intType = findOrAddIntType(module);
+	std::vector<uint32_t> indices;
+	for (uint32_t i = 0; i < members.size(); ++i) {
+		uint32_t constant = module.newId();
+		module.addGlobal(SpirVModule::makeInstruction(OpConstant, { intType, constant, i }));
+		indices.push_back(constant);
+	}
+
+	std::vector<uint32_t> structOperands;
+	uint32_t structType = module.newId();
+	structOperands.push_back(structType);
+	for (auto& member : members) structOperands.push_back(member.type);
+	module.addGlobal(SpirVModule::makeInstruction(OpTypeStruct, structOperands));
+	uint32_t blockPointer = module.newId();
+	module.addGlobal(SpirVModule::makeInstruction(OpTypePointer, { blockPointer, StorageClassUniform, structType }));
+	uint32_t block = module.newId();
+	module.addGlobal(SpirVModule::makeInstruction(OpVariable, { blockPointer, block, StorageClassUniform }));
+
+	module.addName(structType, blockName);
+	module.addName(block, instanceName);
+	layout.name = blockName;
+	layout.binding = 0;
+	layout.members.clear();
+	uint32_t offset = 0;
+	for (uint32_t i = 0; i < members.size(); ++i) {
+		module.addMemberName(structType, i, members[i].name);
+		offset = alignTo(offset, memberLayouts[i].alignment);
+		std140.decorateMember(structType, i, offset, memberLayouts[i]);
+
+		UniformLayoutMember member;
+		member.name = members[i].name;
+		member.offset = offset;
+		member.size = memberLayouts[i].size;
+		member.arrayStride = memberLayouts[i].arrayStride;
+		member.matrixStride = memberLayouts[i].matrixStride;
+		layout.members.push_back(member);
+		offset += memberLayouts[i].size;
+	}
+	layout.size = alignTo(offset, 16);
+	std140.annotations.push_back(SpirVModule::makeInstruction(OpDecorate, { structType, DecorationBlock }));
+	for (auto& annotation : std140.annotations) {
+		module.addAnnotation(annotation);
+	}
+
+	std::map<uint32_t, uint32_t> memberIndices;
+	std::vector<uint32_t> memberPointers;
+	for (uint32_t i = 0; i < members.size(); ++i) {
+		memberIndices[members[i].id] = i;
+		memberPointers.push_back(module.findOrAddPointerType(StorageClassUniform, members[i].type));
+	}
+
+	// Loads go through an access chain into the block, access chains into a uniform get its member index in front
+	std::vector<std::vector<uint32_t>> instructions;
+	std::set<uint32_t> uniformPointers;
+	bool inFunction = false;
+	for (auto& instruction : module.instructions) {
+		uint32_t op = SpirVModule::opcode(instruction);
+		if (op == OpFunction) inFunction = true;
+		if (op == OpVariable && memberIndices.find(instruction[2]) != memberIndices.end()) continue;
+		// The variables are gone, so are their names and decorations
+		if ((op == OpName || op == OpDecorate || op == OpDecorateId) && memberIndices.find(instruction[1]) != memberIndices.end()) continue;
+		if (!inFunction) {
+			instructions.push_back(instruction);
+			continue;
+		}
+
+		std::vector<uint32_t> rewritten = instruction;
+		if ((op == OpAccessChain || op == OpInBoundsAccessChain) && memberIndices.find(instruction[3]) != memberIndices.end()) {
+			rewritten[3] = block;
+			rewritten.insert(rewritten.begin() + 4, indices[memberIndices[instruction[3]]]);
+			rewritten[0] = (uint32_t)(rewritten.size() << 16) | op;
+			uniformPointers.insert(rewritten[2]);
+		}
+		else if ((op == OpAccessChain || op == OpInBoundsAccessChain) && uniformPointers.find(instruction[3]) != uniformPointers.end()) {
+			uniformPointers.insert(rewritten[2]);
+		}
+		else {
+			for (size_t word : SpirVModule::idOperands(instruction)) {
+				auto member = memberIndices.find(rewritten[word]);
+				if (member == memberIndices.end()) continue;
+				uint32_t pointer = module.newId();
+				instructions.push_back(SpirVModule::makeInstruction(OpAccessChain, { memberPointers[member->second], pointer, block, indices[member->second] }));
+				rewritten[word] = pointer;
+			}
+		}
+		instructions.push_back(rewritten);
+	}
+
+	// Pointers into the block point to uniform memory
+	std::map<uint32_t, uint32_t> pointerPointees;
+	for (auto& instruction : instructions) {
+		if (SpirVModule::opcode(instruction) == OpTypePointer) pointerPointees[instruction[1]] = instruction[3];
+	}
+	std::set<uint32_t> pointeeTypes;
+	for (auto& instruction : instructions) {
+		uint32_t op = SpirVModule::opcode(instruction);
+		if ((op == OpAccessChain || op == OpInBoundsAccessChain) && uniformPointers.find(instruction[2]) != uniformPointers.end()) {
+			pointeeTypes.insert(pointerPointees[instruction[1]]);
+		}
+	}
+	module.instructions = instructions;
+	std::map<uint32_t, uint32_t> uniformPointerTypes;
+	for (uint32_t pointee : pointeeTypes) {
+		uniformPointerTypes[pointee] = module.findOrAddPointerType(StorageClassUniform, pointee);
+	}
+	for (auto& instruction : module.instructions) {
+		uint32_t op = SpirVModule::opcode(instruction);
+		if ((op == OpAccessChain || op == OpInBoundsAccessChain) && uniformPointers.find(instruction[2]) != uniformPointers.end()) {
+			instruction[1] = uniformPointerTypes[pointerPointees[instruction[1]]];
+		}
+	}
+
+	spirv = module.assemble();
+	return true;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "UniformLayout.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace krafix {
+	// Moves the loose, non opaque uniforms of a module into one std140 uniform block named blockName with
+	// the instance name instanceName. Members keep the names of the uniforms and are sorted by name.
+	// Uniforms with initializers, bool components or arrays sized by specialization constants stay loose.
+	// Returns false when nothing was moved.
+	bool wrapUniformsInBlock(std::vector<uint32_t>& spirv, const std::string& blockName, const std::string& instanceName, UniformLayoutBlock& layout);
+}
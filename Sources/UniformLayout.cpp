@@ -0,0 +1,71 @@
+#include "UniformLayout.h"
+#include "Serialization.h"
+
+#include <fstream>
+
+using namespace krafix;
+
+namespace {
+	const uint32_t layoutVersion = 1;
+}
+
+uint32_t krafix::hashUniformName(const std::string& name) {
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < name.size(); ++i) {
+		hash ^= (uint8_t)name[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+void krafix::writeUniformLayout(const char* filename, const std::vector<UniformLayoutBlock>& blocks) {
+	std::ofstream out;
+	out.open(filename, std::ios::binary | std::ios::out);
+
+	out.write("KFXL", 4);
+	writeWord(out, layoutVersion);
+	writeWord(out, (uint32_t)blocks.size());
+	for (auto& block : blocks) {
+		writeWord(out, hashUniformName(block.name));
+		writeWord(out, block.binding);
+		writeWord(out, block.size);
+		writeWord(out, (uint32_t)block.members.size());
+		for (auto& member : block.members) {
+			writeWord(out, hashUniformName(member.name));
+			writeWord(out, member.offset);
+			writeWord(out, member.size);
+			writeWord(out, member.arrayStride);
+			writeWord(out, member.matrixStride);
+			writeWord(out, member.rowMajor ? 1 : 0);
+		}
+	}
+
+	out.close();
+}
+
+void krafix::writeUniformLayoutJson(const char* filename, const std::vector<UniformLayoutBlock>& blocks) {
+	std::ofstream out;
+	out.open(filename, std::ios::binary | std::ios::out);
+
+	out << "{\n\t\"version\": " << layoutVersion << ",\n\t\"blocks\": [";
+	for (size_t i = 0; i < blocks.size(); ++i) {
+		const UniformLayoutBlock& block = blocks[i];
+		out << (i == 0 ? "\n" : ",\n");
+		out << "\t\t{\n\t\t\t\"name\": \"" << escapeJson(block.name) << "\",\n";
+		out << "\t\t\t\"hash\": " << hashUniformName(block.name) << ",\n";
+		out << "\t\t\t\"binding\": " << block.binding << ",\n";
+		out << "\t\t\t\"size\": " << block.size << ",\n";
+		out << "\t\t\t\"members\": [";
+		for (size_t j = 0; j < block.members.size(); ++j) {
+			const UniformLayoutMember& member = block.members[j];
+			out << (j == 0 ? "\n" : ",\n");
+			out << "\t\t\t\t{ \"name\": \"" << escapeJson(member.name) << "\", \"hash\": " << hashUniformName(member.name) << ", \"offset\": " << member.offset
+				<< ", \"size\": " << member.size << ", \"arrayStride\": " << member.arrayStride << ", \"matrixStride\": " << member.matrixStride
+				<< ", \"rowMajor\": " << (member.rowMajor ? "true" : "false") << " }";
+		}
+		out << (block.members.size() > 0 ? "\n\t\t\t]\n" : "]\n") << "\t\t}";
+	}
+	out << (blocks.size() > 0 ? "\n\t]\n}\n" : "]\n}\n");
+
+	out.close();
+}
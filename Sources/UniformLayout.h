@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace krafix {
+	struct UniformLayoutMember {
+		std::string name;
+		unsigned offset = 0;
+		unsigned size = 0;
+		unsigned arrayStride = 0;
+		unsigned matrixStride = 0;
+		bool rowMajor = false;
+	};
+
+	struct UniformLayoutBlock {
+		std::string name;
+		unsigned binding = 0;
+		unsigned size = 0;
+		std::vector<UniformLayoutMember> members;
+	};
+
+	// FNV-1a, also used by the runtime to look up members
+	uint32_t hashUniformName(const std::string& name);
+
+	// Binary layout (all values little endian uint32): "KFXL", version, block count, then per block
+	// name hash, binding, size, member count followed by the members as name hash, offset, size,
+	// array stride, matrix stride and flags (1 = row major).
+	void writeUniformLayout(const char* filename, const std::vector<UniformLayoutBlock>& blocks);
+	void writeUniformLayoutJson(const char* filename, const std::vector<UniformLayoutBlock>& blocks);
+}
@@ -1,9 +1,13 @@
 #include "VarListTranslator.h"
+#include "Serialization.h"
 #include <SPIRV/spirv.hpp>
 #include "../glslang/glslang/Public/ShaderLang.h"
+#include <algorithm>
 #include <fstream>
 #include <string.h>
 #include <iostream>
+#include <string>
+#include <vector>
 
 using namespace krafix;
 
@@ -386,3 +390,243 @@ void VarListTranslator::print() {
 		}
 	}
 }
+
+namespace {
+	struct BinaryVariable {
+		std::string name;
+		std::string type;
+	};
+
+	struct BinaryType {
+		std::string name;
+		std::vector<BinaryVariable> members;
+	};
+
+	bool binaryVariableCompare(const BinaryVariable& a, const BinaryVariable& b) {
+		return a.name < b.name;
+	}
+
+	class StringTable {
+	public:
+		uint32_t add(const std::string& string) {
+			auto found = offsets.find(string);
+			if (found != offsets.end()) {
+				return found->second;
+			}
+			uint32_t offset = (uint32_t)data.size();
+			data.insert(data.end(), string.begin(), string.end());
+			data.push_back(0);
+			offsets[string] = offset;
+			return offset;
+		}
+
+		std::vector<char> data;
+	private:
+		std::map<std::string, uint32_t> offsets;
+	};
+}
+
+ReflectedIds krafix::reflectedIds(const std::vector<unsigned>& spirv) {
+	using namespace spv;
+
+	ReflectedIds ids;
+	std::set<unsigned> named;
+	unsigned wordCount = 1;
+	for (unsigned index = 5; index < spirv.size(); index += wordCount) {
+		wordCount = spirv[index] >> 16;
+		unsigned opcode = spirv[index] & 0xffff;
+		if (opcode == OpName) {
+			named.insert(spirv[index + 1]);
+		}
+		else if (opcode == OpTypeStruct) {
+			ids.structs.insert(spirv[index + 1]);
+		}
+		else if (opcode == OpVariable && named.find(spirv[index + 2]) != named.end()) {
+			StorageClass storage = (StorageClass)spirv[index + 3];
+			if (storage == StorageClassUniformConstant || storage == StorageClassInput || storage == StorageClassOutput) {
+				ids.variables.insert(spirv[index + 2]);
+			}
+		}
+	}
+	return ids;
+}
+
+// All values are little endian uint32, all sections are four byte aligned:
+//   header:  "KFXR", version, stage, then count and byte offset of the types, members, inputs,
+//            outputs, uniforms, textures and cost fields followed by size and byte offset of the string table
+//   type:    name, first member, member count (members are only set for structs)
+//   member:  name, type index (also used for inputs, outputs, uniforms and textures)
+//   cost:    the fields of ShaderCost in declaration order, newer versions only append fields
+// Names are byte offsets of zero terminated strings in the string table. Types are sorted by name,
+// inputs, outputs, uniforms and textures are sorted by name so they can be binary searched.
+void VarListTranslator::writeBinary(const char* filename, const ShaderCost& cost) {
+	using namespace spv;
+
+	const uint32_t binaryVersion = 2;
+
+	std::map<unsigned, Name> names;
+	std::map<unsigned, Type> types;
+	std::map<unsigned, std::vector<std::string>> memberNames;
+
+	std::vector<BinaryType> structs;
+	std::vector<BinaryVariable> inputs, outputs, uniforms, textures;
+	ReflectedIds reflected = reflectedIds(spirv);
+
+	for (unsigned i = 0; i < instructions.size(); ++i) {
+		Instruction& inst = instructions[i];
+		switch (inst.opcode) {
+		default:
+			namesAndTypes(inst, names, types);
+			break;
+		case OpTypeStruct: {
+			Type t;
+			unsigned id = inst.operands[0];
+			const char* name = names[id].name != NULL ? names[id].name : "";
+			strcpy(t.name, name);
+			types[id] = t;
+			BinaryType structType;
+			structType.name = name;
+			for (unsigned i = 1; i < inst.length; i++) {
+				BinaryVariable member;
+				member.name = memberNames[id].size() >= i ? memberNames[id][i - 1] : "";
+				member.type = types[inst.operands[i]].name;
+				structType.members.push_back(member);
+			}
+			structs.push_back(structType);
+			break;
+		}
+		case OpMemberName: {
+			unsigned id = inst.operands[0];
+			unsigned number = inst.operands[1];
+			while (memberNames[id].size() <= number) {
+				memberNames[id].push_back("");
+			}
+			memberNames[id][number] = (char*)&inst.operands[2];
+			break;
+		}
+		case OpVariable: {
+			id result = inst.operands[1];
+			types[result] = types[inst.operands[0]];
+			StorageClass storage = (StorageClass)inst.operands[2];
+			if (reflected.variables.find(result) == reflected.variables.end()) {
+				break;
+			}
+			BinaryVariable variable;
+			variable.name = names[result].name;
+			variable.type = types[result].name;
+			if (storage == StorageClassUniformConstant) {
+				if (variable.type.substr(0, 7) == "sampler") {
+					textures.push_back(variable);
+				}
+				else {
+					uniforms.push_back(variable);
+				}
+			}
+			else if (storage == StorageClassInput) {
+				inputs.push_back(variable);
+			}
+			else if (storage == StorageClassOutput) {
+				outputs.push_back(variable);
+			}
+			break;
+		}
+		}
+	}
+
+	std::sort(inputs.begin(), inputs.end(), binaryVariableCompare);
+	std::sort(outputs.begin(), outputs.end(), binaryVariableCompare);
+	std::sort(uniforms.begin(), uniforms.end(), binaryVariableCompare);
+	std::sort(textures.begin(), textures.end(), binaryVariableCompare);
+
+	// Every referenced type name gets an entry, structs additionally carry their members
+	std::map<std::string, BinaryType> typeTable;
+	for (auto& structType : structs) {
+		typeTable[structType.name] = structType;
+	}
+	std::vector<BinaryVariable>* lists[] = { &inputs, &outputs, &uniforms, &textures };
+	for (auto list : lists) {
+		for (auto& variable : *list) {
+			typeTable[variable.type].name = variable.type;
+		}
+	}
+	for (auto& structType : structs) {
+		for (auto& member : structType.members) {
+			typeTable[member.type].name = member.type;
+		}
+	}
+
+	std::map<std::string, uint32_t> typeIndices;
+	uint32_t memberCount = 0;
+	for (auto& entry : typeTable) {
+		uint32_t index = (uint32_t)typeIndices.size();
+		typeIndices[entry.first] = index;
+		memberCount += (uint32_t)entry.second.members.size();
+	}
+
+	const uint32_t costFields[] = { cost.instructions, cost.floatAlu, cost.integerAlu, cost.conversions, cost.comparisons, cost.builtinCalls,
+		cost.derivatives, cost.textureSamples, cost.dependentTextureReads, cost.branches, cost.loops, cost.worstCasePath, cost.temporaries };
+	const uint32_t costFieldCount = sizeof(costFields) / sizeof(costFields[0]);
+
+	StringTable strings;
+	const uint32_t headerSize = 4 * 19;
+	uint32_t typesOffset = headerSize;
+	uint32_t membersOffset = typesOffset + (uint32_t)typeTable.size() * 3 * 4;
+	uint32_t inputsOffset = membersOffset + memberCount * 2 * 4;
+	uint32_t outputsOffset = inputsOffset + (uint32_t)inputs.size() * 2 * 4;
+	uint32_t uniformsOffset = outputsOffset + (uint32_t)outputs.size() * 2 * 4;
+	uint32_t texturesOffset = uniformsOffset + (uint32_t)uniforms.size() * 2 * 4;
+	uint32_t costOffset = texturesOffset + (uint32_t)textures.size() * 2 * 4;
+	uint32_t stringsOffset = costOffset + costFieldCount * 4;
+
+	std::vector<uint32_t> body;
+	uint32_t firstMember = 0;
+	for (auto& entry : typeTable) {
+		body.push_back(strings.add(entry.first));
+		body.push_back(firstMember);
+		body.push_back((uint32_t)entry.second.members.size());
+		firstMember += (uint32_t)entry.second.members.size();
+	}
+	for (auto& entry : typeTable) {
+		for (auto& member : entry.second.members) {
+			body.push_back(strings.add(member.name));
+			body.push_back(typeIndices[member.type]);
+		}
+	}
+	for (auto list : lists) {
+		for (auto& variable : *list) {
+			body.push_back(strings.add(variable.name));
+			body.push_back(typeIndices[variable.type]);
+		}
+	}
+	body.insert(body.end(), costFields, costFields + costFieldCount);
+	while (strings.data.size() % 4 != 0) {
+		strings.data.push_back(0);
+	}
+
+	std::ofstream out;
+	out.open(filename, std::ios::binary | std::ios::out);
+	out.write("KFXR", 4);
+	writeWord(out, binaryVersion);
+	writeWord(out, (uint32_t)stage);
+	writeWord(out, (uint32_t)typeTable.size());
+	writeWord(out, typesOffset);
+	writeWord(out, memberCount);
+	writeWord(out, membersOffset);
+	writeWord(out, (uint32_t)inputs.size());
+	writeWord(out, inputsOffset);
+	writeWord(out, (uint32_t)outputs.size());
+	writeWord(out, outputsOffset);
+	writeWord(out, (uint32_t)uniforms.size());
+	writeWord(out, uniformsOffset);
+	writeWord(out, (uint32_t)textures.size());
+	writeWord(out, texturesOffset);
+	writeWord(out, costFieldCount);
+	writeWord(out, costOffset);
+	writeWord(out, (uint32_t)strings.data.size());
+	writeWord(out, stringsOffset);
+	for (auto word : body) {
+		writeWord(out, word);
+	}
+	out.write(strings.data.data(), strings.data.size());
+	out.close();
+}
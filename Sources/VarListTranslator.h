@@ -1,12 +1,26 @@
 #pragma once
 
+#include "ShaderCost.h"
 #include "Translator.h"
 
+#include <set>
+
 namespace krafix {
+	// Ids whose names the binary reflection records: named input, output and uniform constant variables
+	// and every struct, whose member names are recorded as well
+	struct ReflectedIds {
+		std::set<unsigned> variables;
+		std::set<unsigned> structs;
+	};
+
+	ReflectedIds reflectedIds(const std::vector<unsigned>& spirv);
+
 	class VarListTranslator : public Translator {
 	public:
 		VarListTranslator(std::vector<unsigned>& spirv, ShaderStage stage) : Translator(spirv, stage) {}
 		void outputCode(const Target& target, const char* sourcefilename, const char* filename, char* output, std::map<std::string, int>& attributes) override;
 		void print();
+		// Versioned binary reflection, see the comment above writeBinary in VarListTranslator.cpp for the layout
+		void writeBinary(const char* filename, const ShaderCost& cost);
 	};
 }
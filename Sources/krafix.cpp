@@ -53,6 +53,9 @@
 #include <cctype>
 #include <cmath>
 #include <array>
+#include <fstream>
+#include <iterator>
+#include <memory>
 #include <sstream>
 
 #include "../glslang/OSDependent/osinclude.h"
@@ -66,6 +69,13 @@
 #include "MetalTranslator.h"
 #include "MetalTranslator2.h"
 #include "VarListTranslator.h"
+#include "StageInterface.h"
+#include "ShaderCost.h"
+#include "ResourceUsage.h"
+#include "DescriptorPlan.h"
+#include "GlslMinifier.h"
+#include "MetalBundle.h"
+#include "PostCommand.h"
 #include "JavaScriptTranslator.h"
 #include "JavaScriptTranslator2.h"
 
@@ -133,6 +143,46 @@ bool LinkFailed = false;
 static bool quiet = false;
 static bool debugMode = false;
 static bool outputSpirv = false;
+static bool spirvOptReport = false;
+static bool spirvCompact = false;
+static bool spirvStripDebug = false;
+static std::string specializationConstants;
+static bool specializeTextureUnits = false;
+static bool deterministic = false;
+static bool packUniforms = false;
+static bool uniformBlocks = false;
+static bool minify = false;
+static bool autoPrecision = false;
+static bool uniformLayout = false;
+static bool uniformLayoutJson = false;
+static bool binaryReflection = false;
+static bool packVaryings = false;
+static bool shaderCost = false;
+static bool reportUnused = false;
+static bool stripUnused = false;
+static bool descriptorSets = false;
+static bool argumentBuffers = false;
+static std::map<std::string, krafix::UpdateFrequency> descriptorFrequencies;
+static std::string costReport;
+static int soakIterations = 0;
+static std::string d3dBytecodeCommand;
+static std::vector<std::string> postCommands;
+static unsigned postJobs = 0;
+static krafix::PostCommandPool* postCommandPool = nullptr;
+static std::string pairSource;
+static std::string primaryOutputBase;
+static std::string pairOutputBase;
+
+// GLSL outputs of the current compile, all emitted from the same SPIR-V, the first one is the compile's own output.
+// A version of 0 keeps the target's version. Each flavour fails on its own.
+struct GlslFlavour {
+	std::string filename;
+	std::string pairFilename;
+	int version;
+	bool relax;
+	bool failed;
+};
+static std::vector<GlslFlavour> glslFlavours;
 
 // Use to test breaking up a single shader file into multiple strings.
 // Set in ReadFileData().
@@ -592,9 +642,50 @@ struct ShaderCompUnit {
 
 };
 
-void executeSync(const char* command);
-int compileHLSLToD3D9(const char* from, const char* to, const char* source, char* output, int* length, const std::map<std::string, int>& attributes, EShLanguage stage);
-int compileHLSLToD3D11(const char* from, const char* to, const char* source, char* output, int* length, const std::map<std::string, int>& attributes, EShLanguage stage, bool debug);
+int executeSync(const char* command);
+size_t residentMemory();
+int compileHLSLToD3D9(const char* from, const char* to, const char* source, char* output, int* length, const krafix::D3DContainer& container, EShLanguage stage, int shaderModel);
+int compileHLSLToD3D11(const char* from, const char* to, const char* source, char* output, int* length, const krafix::D3DContainer& container, EShLanguage stage, int shaderModel, bool debug,
+	krafix::D3DBytecodeCompiler compileBytecode);
+bool compileD3D11Bytecode(const char* from, const char* source, const char* profile, bool debug, std::vector<char>& bytecode, std::string& errors);
+
+// Runs --d3d-bytecode-command as "command profile input.hlsl output.bytecode", for building D3D11 shaders without D3DCompile
+bool runD3DBytecodeCommand(const char* from, const char* source, const char* profile, bool debug, std::vector<char>& bytecode, std::string& errors) {
+	if (source != nullptr) {
+		errors = "--d3d-bytecode-command needs a temp directory to write the HLSL to.\n";
+		return false;
+	}
+	std::string blob = std::string(from) + ".bytecode";
+	remove(blob.c_str());
+	std::string command = d3dBytecodeCommand + " " + profile + " \"" + from + "\" \"" + blob + "\"";
+	int code = executeSync(command.c_str());
+	if (code != 0) {
+		errors = "Error: " + command + " failed with exit code " + std::to_string(code) + ".\n";
+		remove(blob.c_str());
+		return false;
+	}
+
+	{
+		std::ifstream in(blob.c_str(), std::ios_base::binary);
+		bytecode.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+	remove(blob.c_str());
+	if (bytecode.empty()) {
+		errors = "Error: " + d3dBytecodeCommand + " did not write " + blob + ".\n";
+		return false;
+	}
+	return true;
+}
+
+// Reports a finished output file and hands it to the --post-command tools, which run while the next output is translated
+void finishedOutput(const std::string& filename) {
+	if (!quiet) {
+		std::cerr << "#file:" << filename << std::endl;
+	}
+	if (postCommandPool != nullptr) {
+		postCommandPool->add(filename);
+	}
+}
 
 std::string extractFilename(std::string path) {
 	int i = (int)path.size() - 1;
@@ -618,6 +709,103 @@ std::string removeExtension(std::string filename) {
 	else return filename.substr(0, i);
 }
 
+// Reads a shader including everything it pulls in via #include "..."
+std::string readSourceWithIncludes(const std::string& filename, int depth = 0) {
+	std::string dir = filename.substr(0, filename.size() - extractFilename(filename).size());
+	std::stringstream content;
+	std::string line;
+	std::ifstream file(filename);
+	if (!file.is_open()) return "";
+	while (getline(file, line)) {
+		content << line << '\n';
+		size_t start = line.find_first_not_of(" \t");
+		if (depth < 16 && start != std::string::npos && line.compare(start, 8, "#include") == 0) {
+			size_t open = line.find('"', start);
+			size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+			if (close != std::string::npos) {
+				content << readSourceWithIncludes(dir + line.substr(open + 1, close - open - 1), depth + 1);
+			}
+		}
+	}
+	file.close();
+	return content.str();
+}
+
+static bool isIdentifierCharacter(char c) {
+	return isalnum((unsigned char)c) || c == '_';
+}
+
+bool mentionsIdentifier(const std::string& source, const std::string& name) {
+	for (size_t position = source.find(name); position != std::string::npos; position = source.find(name, position + 1)) {
+		bool startsWord = position == 0 || !isIdentifierCharacter(source[position - 1]);
+		bool endsWord = position + name.size() >= source.size() || !isIdentifierCharacter(source[position + name.size()]);
+		if (startsWord && endsWord) return true;
+	}
+	return false;
+}
+
+// Whether name appears in a preprocessor directive, which rules out turning it into a specialization constant
+bool usedInPreprocessor(const std::string& source, const std::string& name) {
+	std::stringstream stream(source);
+	std::string line;
+	while (getline(stream, line)) {
+		size_t start = line.find_first_not_of(" \t");
+		if (start == std::string::npos || line[start] != '#') continue;
+		for (size_t position = line.find(name); position != std::string::npos; position = line.find(name, position + 1)) {
+			bool startsWord = position == 0 || !isIdentifierCharacter(line[position - 1]);
+			bool endsWord = position + name.size() >= line.size() || !isIdentifierCharacter(line[position + name.size()]);
+			if (startsWord && endsWord) return true;
+		}
+	}
+	return false;
+}
+
+// Puts the declarations behind the #version directive and the #extension and #pragma lines following it, which
+// have to come before any declaration, and restores the original line numbers
+std::string insertSpecializationConstants(const char* source, const std::string& declarations) {
+	std::string text(source);
+	size_t insertion = std::string::npos;
+	int insertionLine = 0;
+	bool comment = false;
+	size_t lineStart = 0;
+	int line = 1;
+	while (lineStart < text.size()) {
+		size_t lineEnd = text.find('\n', lineStart);
+		if (lineEnd == std::string::npos) lineEnd = text.size();
+		std::string code;
+		for (size_t i = lineStart; i < lineEnd; ++i) {
+			if (comment) {
+				if (text.compare(i, 2, "*/") == 0) {
+					comment = false;
+					++i;
+				}
+			}
+			else if (text.compare(i, 2, "//") == 0) break;
+			else if (text.compare(i, 2, "/*") == 0) {
+				comment = true;
+				++i;
+			}
+			else code += text[i];
+		}
+		size_t start = code.find_first_not_of(" \t\r");
+		if (start != std::string::npos) {
+			bool directive = insertion == std::string::npos ? code.compare(start, 8, "#version") == 0
+				: code.compare(start, 10, "#extension") == 0 || code.compare(start, 7, "#pragma") == 0;
+			if (!directive) break;
+			insertion = lineEnd;
+			insertionLine = line;
+		}
+		lineStart = lineEnd + 1;
+		++line;
+	}
+	if (insertion == std::string::npos) return declarations + "#line 1\n" + text;
+	if (insertion < text.size()) {
+		++insertion;
+		return text.substr(0, insertion) + declarations + "#line " + std::to_string(insertionLine + 1) + "\n" + text.substr(insertion);
+	}
+	return text + "\n" + declarations + "#line " + std::to_string(insertionLine + 1) + "\n";
+}
+
 static bool deps = false;
 static std::vector<std::string> dependencies;
 
@@ -659,7 +847,7 @@ public:
 	}
 
 	void releaseInclude(IncludeResult* result) override {
-		delete (char*)result->userData;
+		delete[] (char*)result->userData;
 		delete result;
 	}
 private:
@@ -719,6 +907,7 @@ static void preprocessSpirv(std::vector<unsigned int>& spirv) {
 	const unsigned OpTypeArray = 28;
 	const unsigned OpTypePointer = 32;
 	const unsigned OpConstant = 43;
+	const unsigned OpSpecConstant = 50;
 	const unsigned OpVariable = 59;
 	const unsigned OpDecorate = 71;
 
@@ -745,7 +934,7 @@ static void preprocessSpirv(std::vector<unsigned int>& spirv) {
 			imageTypes.insert(operands[0]);
 		}
 
-		if (opcode == OpConstant) {
+		if (opcode == OpConstant || opcode == OpSpecConstant) {
 			constants[operands[1]] = operands[2];
 		}
 
@@ -798,7 +987,7 @@ static void preprocessSpirv(std::vector<unsigned int>& spirv) {
 //
 
 void CompileAndLinkShaderUnits(std::vector<ShaderCompUnit> compUnits, krafix::Target target, const char* sourcefilename, const char* filename, const char* tempdir, char* output, int* length,
-	glslang::TShader::Includer& includer, const char* defines, bool relax)
+	glslang::TShader::Includer& includer, const char* defines, bool relax, const char* pairFilename)
 {
 	// keep track of what to free
 	std::list<glslang::TShader*> shaders;
@@ -895,41 +1084,150 @@ void CompileAndLinkShaderUnits(std::vector<ShaderCompUnit> compUnits, krafix::Ta
 		if (CompileFailed || LinkFailed)
 			printf("SPIR-V is not generated for failed compile or link\n");
 		else {
+			// All stages are generated first so linked stages can be optimized against each other
+			std::map<int, std::vector<uint32_t>> spirvs;
 			for (int stage = 0; stage < EShLangCount; ++stage) {
 				if (program.getIntermediate((EShLanguage)stage)) {
-					std::vector<uint32_t> spirv;
-					std::string warningsErrors;
+					std::vector<uint32_t>& spirv = spirvs[stage];
 					spv::SpvBuildLogger logger;
 					glslang::GlslangToSpv(*program.getIntermediate((EShLanguage)stage), spirv, &logger);
 
-					if (outputSpirv) {
-						std::string filename = std::string(tempdir) + "/" + removeExtension(extractFilename(sourcefilename)) + ".spirv";
-						writeSpirv(filename.c_str(), spirv);
+					if (deterministic && spirv.size() > 2) {
+						// Keep the generator's tool id but drop glslang's version so outputs don't change with the glslang revision
+						spirv[2] &= 0xffff0000;
+					}
+				}
+			}
+
+			if (pairFilename != nullptr && spirvs.find(EShLangVertex) != spirvs.end() && spirvs.find(EShLangFragment) != spirvs.end()) {
+				std::vector<std::string> removed = krafix::trimUnusedVaryings(spirvs[EShLangVertex], spirvs[EShLangFragment]);
+				if (!quiet) {
+					for (auto name : removed) {
+						std::cerr << "#trimmed:" << name << std::endl;
+					}
+				}
+				if (packVaryings && target.lang == krafix::GLSL) {
+					std::vector<std::string> packed = krafix::packVaryings(spirvs[EShLangVertex], spirvs[EShLangFragment]);
+					if (!quiet) {
+						for (auto varying : packed) {
+							std::cerr << "#packed:" << varying << std::endl;
+						}
+					}
+				}
+			}
+
+			// Runs before preprocessSpirv and the descriptor planning so the remaining resources get consecutive bindings
+			if (stripUnused || reportUnused) {
+				for (auto& stageSpirv : spirvs) {
+					std::vector<std::string> unused = stripUnused ? krafix::stripUnusedResources(stageSpirv.second) : krafix::findUnusedResources(stageSpirv.second);
+					if (!quiet) {
+						for (auto name : unused) {
+							std::cerr << "#unused:" << name << std::endl;
+						}
+					}
+				}
+			}
+
+			std::vector<krafix::DescriptorBinding> descriptorPlan;
+			if ((descriptorSets && target.lang == krafix::SpirV) || (argumentBuffers && target.lang == krafix::Metal)) {
+				std::map<krafix::ShaderStage, std::vector<uint32_t>> stages;
+				for (auto& stageSpirv : spirvs) {
+					stages[shLanguageToShaderStage((EShLanguage)stageSpirv.first)] = stageSpirv.second;
+				}
+				std::string planErrors;
+				descriptorPlan = krafix::planDescriptors(stages, descriptorFrequencies, planErrors);
+				if (!planErrors.empty()) {
+					std::cerr << planErrors;
+					CompileFailed = true;
+				}
+				else if (output == nullptr && target.lang == krafix::SpirV) {
+					krafix::writeDescriptorLayoutJson((std::string(filename) + ".descriptors.json").c_str(), descriptorPlan);
+				}
+				else if (output == nullptr) {
+					krafix::writeArgumentBufferLayoutJson((std::string(filename) + ".argbuffers.json").c_str(), descriptorPlan);
+				}
+			}
+
+			// The WebGL flavours only differ in the GLSL translation and share everything up to here
+			bool sharedFlavours = target.lang == krafix::GLSL && output == nullptr && !glslFlavours.empty();
+			std::vector<GlslFlavour> flavours;
+			if (sharedFlavours) {
+				flavours = glslFlavours;
+			}
+			else {
+				flavours.push_back({ filename, pairFilename != nullptr ? pairFilename : "", 0, relax, false });
+			}
+
+			// Flavours and variants of a stage often end up with equal modules which then are parsed once
+			krafix::CrossIRCache crossIR;
+
+			static bool firstRun = true;
+			for (auto& stageSpirv : spirvs) {
+				int stage = stageSpirv.first;
+				std::vector<uint32_t>& spirv = stageSpirv.second;
+
+				bool pairStage = pairFilename != nullptr && compUnits.size() > 1 && compUnits[1].stage == stage;
+				const char* stageSourcefilename = pairStage ? compUnits[1].fileName.c_str() : sourcefilename;
+
+				if (outputSpirv) {
+					std::string filename = std::string(tempdir) + "/" + removeExtension(extractFilename(stageSourcefilename)) + ".spirv";
+					writeSpirv(filename.c_str(), spirv);
+				}
+
+				preprocessSpirv(spirv);
+
+				if (!quiet && firstRun) {
+					krafix::VarListTranslator varPrinter(spirv, shLanguageToShaderStage((EShLanguage)stage));
+					varPrinter.print();
+				}
+
+				for (size_t flavourIndex = 0; flavourIndex < flavours.size(); ++flavourIndex) {
+					const GlslFlavour& flavour = flavours[flavourIndex];
+					krafix::Target flavourTarget = target;
+					if (flavour.version > 0) flavourTarget.version = flavour.version;
+					const char* stageFilename = pairStage ? flavour.pairFilename.c_str() : flavour.filename.c_str();
+
+					krafix::ShaderCost cost;
+					if ((binaryReflection || shaderCost || !costReport.empty()) && output == nullptr) {
+						cost = krafix::estimateCost(spirv);
 					}
 
-					preprocessSpirv(spirv);
+					if (binaryReflection && output == nullptr) {
+						krafix::VarListTranslator reflection(spirv, shLanguageToShaderStage((EShLanguage)stage));
+						reflection.writeBinary((std::string(stageFilename) + ".reflection").c_str(), cost);
+					}
 
-					static bool firstRun = true;
-					if (!quiet && firstRun) {
-						krafix::VarListTranslator* varPrinter = new krafix::VarListTranslator(spirv, shLanguageToShaderStage((EShLanguage)stage));
-						varPrinter->print();
-						firstRun = false;
+					if ((shaderCost || !costReport.empty()) && output == nullptr) {
+						if (shaderCost) {
+							std::ofstream costFile((std::string(stageFilename) + ".cost.json").c_str(), std::ios::binary);
+							costFile << krafix::costJson(cost, shLanguageToShaderStage((EShLanguage)stage), stageFilename, true) << "\n";
+						}
+						if (!costReport.empty()) {
+							// One line per output, several krafix processes of a batch append to the same report
+							std::ofstream report(costReport.c_str(), std::ios::binary | std::ios::app);
+							report << krafix::costJson(cost, shLanguageToShaderStage((EShLanguage)stage), stageFilename, false) << "\n";
+						}
 					}
 
 					krafix::Translator* translator = NULL;
 					std::map<std::string, int> attributes;
-					switch (target.lang) {
+					switch (flavourTarget.lang) {
 					case krafix::SpirV:
 						translator = new krafix::SpirVTranslator(spirv, shLanguageToShaderStage((EShLanguage)stage));
+						((krafix::SpirVTranslator*)translator)->descriptors = descriptorPlan;
 						break;
 					case krafix::GLSL:
-						translator = new krafix::GlslTranslator2(spirv, shLanguageToShaderStage((EShLanguage)stage), relax);
+						translator = new krafix::GlslTranslator2(spirv, shLanguageToShaderStage((EShLanguage)stage), flavour.relax);
+						((krafix::GlslTranslator2*)translator)->crossIR = &crossIR;
 						break;
 					case krafix::HLSL:
 						translator = new krafix::HlslTranslator2(spirv, shLanguageToShaderStage((EShLanguage)stage));
+						((krafix::HlslTranslator2*)translator)->crossIR = &crossIR;
 						break;
 					case krafix::Metal:
 						translator = new krafix::MetalTranslator2(spirv, shLanguageToShaderStage((EShLanguage)stage));
+						((krafix::MetalTranslator2*)translator)->descriptors = descriptorPlan;
+						((krafix::MetalTranslator2*)translator)->crossIR = &crossIR;
 						break;
 					case krafix::AGAL:
 						translator = new krafix::AgalTranslator(spirv, shLanguageToShaderStage((EShLanguage)stage));
@@ -943,50 +1241,98 @@ void CompileAndLinkShaderUnits(std::vector<ShaderCompUnit> compUnits, krafix::Ta
 					}
 
 					try {
-						if (target.lang == krafix::HLSL && target.system != krafix::Unity) {
-							std::string temp = tempdir == nullptr ? "" : std::string(tempdir) + "/" + removeExtension(extractFilename(sourcefilename)) + ".hlsl";
+						if (flavourTarget.lang == krafix::HLSL && flavourTarget.system != krafix::Unity) {
+							std::string temp = tempdir == nullptr ? "" : std::string(tempdir) + "/" + removeExtension(extractFilename(stageSourcefilename)) + ".hlsl";
 							char* tempoutput = nullptr;
 							if (output) {
 								tempoutput = new char[1024 * 1024];
 							}
-							translator->outputCode(target, sourcefilename, temp.c_str(), tempoutput, attributes);
-							int returnCode = 0;
-							if (target.version == 9) {
-								returnCode = compileHLSLToD3D9(temp.c_str(), filename, tempoutput, output, length, attributes, (EShLanguage)stage);
-							}
-							else {
-								returnCode = compileHLSLToD3D11(temp.c_str(), filename, tempoutput, output, length, attributes, (EShLanguage)stage, debugMode);
+							translator->outputCode(flavourTarget, stageSourcefilename, temp.c_str(), tempoutput, attributes);
+							krafix::HlslTranslator2* hlslTranslator = dynamic_cast<krafix::HlslTranslator2*>(translator);
+							int shaderModel = hlslTranslator->shaderModel;
+							auto compileBytecode = [&](int shaderModel) -> int {
+								if (flavourTarget.version == 9) {
+									return compileHLSLToD3D9(temp.c_str(), stageFilename, tempoutput, output, length, hlslTranslator->container, (EShLanguage)stage, shaderModel);
+								}
+								return compileHLSLToD3D11(temp.c_str(), stageFilename, tempoutput, output, length, hlslTranslator->container, (EShLanguage)stage, shaderModel, debugMode,
+									d3dBytecodeCommand.empty() ? compileD3D11Bytecode : runD3DBytecodeCommand);
+							};
+							int returnCode = compileBytecode(shaderModel);
+							// The inference counts SPIR-V instructions, fxc can still run out of 2.0 slots or need a 5.0 feature
+							if (returnCode != 0 && (shaderModel == 20 || shaderModel == 40)) {
+								std::cerr << "Warning: " << stageSourcefilename << " does not compile for shader model " << shaderModel / 10 << ".0, retrying with "
+									<< shaderModel / 10 + 1 << ".0" << std::endl;
+								returnCode = compileBytecode(shaderModel + 10);
 							}
 							if (returnCode != 0) CompileFailed = true;
 							delete[] tempoutput;
 						}
-						else if (target.lang == krafix::SpirV) {
-							translator->outputCode(target, sourcefilename, filename, output, attributes);
+						else if (flavourTarget.lang == krafix::SpirV) {
+							translator->outputCode(flavourTarget, stageSourcefilename, stageFilename, output, attributes);
+							krafix::SpirVTranslator* spirvTranslator = dynamic_cast<krafix::SpirVTranslator*>(translator);
 							if (output != nullptr) {
-								*length = dynamic_cast<krafix::SpirVTranslator*>(translator)->outputLength;
+								*length = spirvTranslator->outputLength;
+							}
+							if (!quiet && flavourTarget.packUniforms) {
+								for (auto& block : spirvTranslator->uniformBlocks) {
+									for (auto& member : block.members) {
+										std::cerr << "#offset:" << member.name << ":" << member.offset << ":" << member.size << std::endl;
+									}
+								}
 							}
 						}
 						else {
-							translator->outputCode(target, sourcefilename, filename, output, attributes);
+							translator->outputCode(flavourTarget, stageSourcefilename, stageFilename, output, attributes);
 							if (output != nullptr) {
 								*length = (int)strlen(output);
 							}
 						}
 					}
 					catch (spirv_cross::CompilerError& error) {
-						printf("Error compiling to %s: %s\n", target.string().c_str(), error.what());
+						printf("Error compiling to %s: %s\n", flavourTarget.string().c_str(), error.what());
+						if (sharedFlavours) {
+							// Like the separate compiles this replaces, a failing flavour does not fail the others
+							glslFlavours[flavourIndex].failed = true;
+							delete translator;
+							continue;
+						}
 						CompileFailed = true;
 					}
 
-					delete translator;
+					if ((uniformLayout || uniformLayoutJson) && output == nullptr && !CompileFailed) {
+						std::vector<krafix::UniformLayoutBlock>* blocks = nullptr;
+						if (krafix::SpirVTranslator* spirvTranslator = dynamic_cast<krafix::SpirVTranslator*>(translator)) {
+							blocks = &spirvTranslator->uniformBlocks;
+						}
+						else if (krafix::HlslTranslator2* hlslTranslator = dynamic_cast<krafix::HlslTranslator2*>(translator)) {
+							// Direct3D 9 has no constant buffers, the registers are only known from the compiled constant table
+							if (flavourTarget.version > 9) blocks = &hlslTranslator->uniformBlocks;
+						}
+						else if (krafix::GlslTranslator2* glslTranslator = dynamic_cast<krafix::GlslTranslator2*>(translator)) {
+							blocks = &glslTranslator->uniformBlocks;
+						}
+						if (blocks != nullptr) {
+							if (uniformLayout) krafix::writeUniformLayout((std::string(stageFilename) + ".layout").c_str(), *blocks);
+							if (uniformLayoutJson) krafix::writeUniformLayoutJson((std::string(stageFilename) + ".layout.json").c_str(), *blocks);
+						}
+					}
 
-					//glslang::OutputSpv(spirv, GetBinaryName((EShLanguage)stage));
-					if (Options & EOptionHumanReadableSpv) {
-						spv::Parameterize();
-						spv::Disassemble(std::cout, spirv);
+					if (flavourTarget.minify && output == nullptr && !CompileFailed) {
+						if (krafix::GlslTranslator2* glslTranslator = dynamic_cast<krafix::GlslTranslator2*>(translator)) {
+							krafix::writeNameMapJson((std::string(stageFilename) + ".names.json").c_str(), glslTranslator->minifiedNames);
+						}
 					}
+
+					delete translator;
+				}
+
+				//glslang::OutputSpv(spirv, GetBinaryName((EShLanguage)stage));
+				if (Options & EOptionHumanReadableSpv) {
+					spv::Parameterize();
+					spv::Disassemble(std::cout, spirv);
 				}
 			}
+			firstRun = false;
 		}
 	}
 
@@ -1029,7 +1375,8 @@ krafix::TargetSystem getSystem(const char* system) {
 // performance and memory testing, the actual compile/link can be put in
 // a loop, independent of processing the work items and file IO.
 //
-void CompileAndLinkShaderFiles(krafix::Target target, const char* sourcefilename, const char* filename, const char* tempdir, const char* source, char* output, int* length, glslang::TShader::Includer& includer, const char* defines, bool relax)
+void CompileAndLinkShaderFiles(krafix::Target target, const char* sourcefilename, const char* filename, const char* tempdir, const char* source, char* output, int* length, glslang::TShader::Includer& includer, const char* defines, bool relax,
+	const char* pairFilename)
 {
 	std::vector<ShaderCompUnit> compUnits;
 
@@ -1040,6 +1387,7 @@ void CompileAndLinkShaderFiles(krafix::Target target, const char* sourcefilename
 	// they are all getting linked together.)
 
 	char* sources[] = { (char*)source, nullptr, nullptr, nullptr, nullptr };
+	std::string specializedSource;
 
 	glslang::TWorkItem* workItem;
 	while (Worklist.remove(workItem)) {
@@ -1050,10 +1398,27 @@ void CompileAndLinkShaderFiles(krafix::Target target, const char* sourcefilename
 		);
 
 		if (!compUnit.text) {
+			if (source == nullptr) {
+				for (auto& unit : compUnits) FreeFileData(unit.text);
+			}
 			usage();
 			return;
 		}
 
+		if (!specializationConstants.empty() && target.lang == krafix::SpirV && compUnit.text[0] != nullptr) {
+			if (source != nullptr) {
+				specializedSource = insertSpecializationConstants(source, specializationConstants);
+				sources[0] = (char*)specializedSource.c_str();
+			}
+			else {
+				std::string specialized = insertSpecializationConstants(compUnit.text[0], specializationConstants);
+				char* text = (char*)malloc(specialized.size() + 1); // freed in FreeFileData()
+				strcpy(text, specialized.c_str());
+				free(compUnit.text[0]);
+				compUnit.text[0] = text;
+			}
+		}
+
 		compUnits.push_back(compUnit);
 	}
 
@@ -1062,7 +1427,7 @@ void CompileAndLinkShaderFiles(krafix::Target target, const char* sourcefilename
 	// all the perf/memory that a programmatic consumer will care about.
 	for (int i = 0; i < ((Options & EOptionMemoryLeakMode) ? 100 : 1); ++i) {
 		for (int j = 0; j < ((Options & EOptionMemoryLeakMode) ? 100 : 1); ++j)
-			CompileAndLinkShaderUnits(compUnits, target, sourcefilename, filename, tempdir, output, length, includer, defines, relax);
+			CompileAndLinkShaderUnits(compUnits, target, sourcefilename, filename, tempdir, output, length, includer, defines, relax, pairFilename);
 
 		if (Options & EOptionMemoryLeakMode)
 			glslang::OS_DumpMemoryCounters();
@@ -1074,6 +1439,14 @@ void CompileAndLinkShaderFiles(krafix::Target target, const char* sourcefilename
 	}
 }
 
+// In pair mode the second stage's output gets the same variant suffix as the first one
+std::string pairOutputFor(const std::string& to, const char* source) {
+	if (!pairSource.empty() && source == nullptr && to.compare(0, primaryOutputBase.size(), primaryOutputBase) == 0) {
+		return pairOutputBase + to.substr(primaryOutputBase.size());
+	}
+	return "";
+}
+
 int compile(const char* targetlang, const char* from, std::string to, const char* tempdir, const char* source, char* output, int* length, const char* system,
 	glslang::TShader::Includer& includer, std::string defines, int version, bool relax) {
 	CompileFailed = false;
@@ -1083,7 +1456,10 @@ int compile(const char* targetlang, const char* from, std::string to, const char
 	Options |= EOptionLinkProgram;
 	//Options |= EOptionSuppressInfolog;
 
-	NumWorkItems = 1;
+	std::string pairOutput = pairOutputFor(to, source);
+	const char* pairFilename = pairOutput.empty() ? nullptr : pairOutput.c_str();
+
+	NumWorkItems = pairFilename != nullptr ? 2 : 1;
 	Work = new glslang::TWorkItem * [NumWorkItems];
 	Work[0] = 0;
 
@@ -1099,36 +1475,47 @@ int compile(const char* targetlang, const char* from, std::string to, const char
 		Work[0] = new glslang::TWorkItem(name);
 		Worklist.add(Work[0]);
 	}
+	if (pairFilename != nullptr) {
+		Work[1] = new glslang::TWorkItem(pairSource);
+		Worklist.add(Work[1]);
+	}
 
 	glslang::InitializeProcess();
 
 	krafix::Target target;
 	target.system = getSystem(system);
 	target.es = false;
+	target.spirvOptReport = spirvOptReport;
+	target.spirvCompact = spirvCompact;
+	target.spirvStripDebug = spirvStripDebug;
+	target.packUniforms = packUniforms;
+	target.uniformBlocks = uniformBlocks;
+	target.minify = minify;
+	target.autoPrecision = autoPrecision;
 	if (strcmp(targetlang, "spirv") == 0) {
 		target.lang = krafix::SpirV;
 		target.version = version > 0 ? version : 1;
 		defines += "#define SPIRV " + std::to_string(target.version) + "\n";
-		CompileAndLinkShaderFiles(target, from, to.c_str(), tempdir, source, output, length, includer, defines.c_str(), relax);
+		CompileAndLinkShaderFiles(target, from, to.c_str(), tempdir, source, output, length, includer, defines.c_str(), relax, pairFilename);
 	}
 	else if (strcmp(targetlang, "d3d9") == 0) {
 		target.lang = krafix::HLSL;
 		target.version = version > 0 ? version : 9;
 		defines += "#define HLSL " + std::to_string(target.version) + "\n";
-		CompileAndLinkShaderFiles(target, from, to.c_str(), tempdir, source, output, length, includer, defines.c_str(), relax);
+		CompileAndLinkShaderFiles(target, from, to.c_str(), tempdir, source, output, length, includer, defines.c_str(), relax, pairFilename);
 	}
 	else if (strcmp(targetlang, "d3d11") == 0) {
 		target.lang = krafix::HLSL;
 		target.version = version > 0 ? version : 11;
 		defines += "#define HLSL " + std::to_string(target.version) + "\n";
-		CompileAndLinkShaderFiles(target, from, to.c_str(), tempdir, source, output, length, includer, defines.c_str(), relax);
+		CompileAndLinkShaderFiles(target, from, to.c_str(), tempdir, source, output, length, includer, defines.c_str(), relax, pairFilename);
 	}
 	else if (strcmp(targetlang, "glsl") == 0) {
 		target.lang = krafix::GLSL;
 		if (target.system == krafix::Linux && (FindLanguage(from) == EShLangVertex || FindLanguage(from) == EShLangFragment)) target.version = version > 0 ? version : 110;
 		else target.version = version > 0 ? version : 330;
 		defines += "#define GLSL " + std::to_string(target.version) + "\n";
-		CompileAndLinkShaderFiles(target, from, to.c_str(), tempdir, source, output, length, includer, defines.c_str(), relax);
+		CompileAndLinkShaderFiles(target, from, to.c_str(), tempdir, source, output, length, includer, defines.c_str(), relax, pairFilename);
 	}
 	else if (strcmp(targetlang, "essl") == 0) {
 		target.lang = krafix::GLSL;
@@ -1136,45 +1523,65 @@ int compile(const char* targetlang, const char* from, std::string to, const char
 		else target.version = version > 0 ? version : 310;
 		target.es = true;
 		defines += "#define GLSL " + std::to_string(target.version) + "\n";
-		CompileAndLinkShaderFiles(target, from, to.c_str(), tempdir, source, output, length, includer, defines.c_str(), relax);
+		CompileAndLinkShaderFiles(target, from, to.c_str(), tempdir, source, output, length, includer, defines.c_str(), relax, pairFilename);
 	}
 	else if (strcmp(targetlang, "agal") == 0) {
 		target.lang = krafix::AGAL;
 		target.version = version > 0 ? version : 100;
 		target.es = true;
 		defines += "#define AGAL " + std::to_string(target.version) + "\n";
-		CompileAndLinkShaderFiles(target, from, to.c_str(), tempdir, source, output, length, includer, defines.c_str(), relax);
+		CompileAndLinkShaderFiles(target, from, to.c_str(), tempdir, source, output, length, includer, defines.c_str(), relax, pairFilename);
 	}
 	else if (strcmp(targetlang, "metal") == 0) {
 		target.lang = krafix::Metal;
 		target.version = version > 0 ? version : 1;
 		defines += "#define METAL " + std::to_string(target.version) + "\n";
-		CompileAndLinkShaderFiles(target, from, to.c_str(), tempdir, source, output, length, includer, defines.c_str(), relax);
+		CompileAndLinkShaderFiles(target, from, to.c_str(), tempdir, source, output, length, includer, defines.c_str(), relax, pairFilename);
 	}
 	else if (strcmp(targetlang, "varlist") == 0) {
 		target.lang = krafix::VarList;
 		target.version = version > 0 ? version : 1;
-		CompileAndLinkShaderFiles(target, from, to.c_str(), tempdir, source, output, length, includer, defines.c_str(), relax);
+		CompileAndLinkShaderFiles(target, from, to.c_str(), tempdir, source, output, length, includer, defines.c_str(), relax, pairFilename);
 	}
 	else if (strcmp(targetlang, "js") == 0 || strcmp(targetlang, "javascript") == 0) {
 		target.lang = krafix::JavaScript;
 		target.version = version > 0 ? version : 1;
-		CompileAndLinkShaderFiles(target, from, to.c_str(), tempdir, source, output, length, includer, defines.c_str(), relax);
+		CompileAndLinkShaderFiles(target, from, to.c_str(), tempdir, source, output, length, includer, defines.c_str(), relax, pairFilename);
 	}
 	else {
 		std::cout << "Unknown profile " << targetlang << std::endl;
 		CompileFailed = true;
 	}
-	if (!CompileFailed && !quiet) {
-		std::cerr << "#file:" << to << std::endl;
+	// compileOptionallyRelaxed reports shared flavours one by one
+	if (!CompileFailed && output == nullptr && glslFlavours.empty()) {
+		finishedOutput(to);
+		if (pairFilename != nullptr) {
+			finishedOutput(pairOutput);
+		}
 	}
 
+	for (int i = 0; i < NumWorkItems; ++i) {
+		delete Work[i];
+	}
+	delete[] Work;
+	Work = nullptr;
+	NumWorkItems = 0;
+
 	glslang::FinalizeProcess();
 
 	if (CompileFailed || LinkFailed) return 1;
 	else return 0;
 }
 
+// The WebGL 1, WebGL 2 and relaxed outputs can come from one front end run when nothing looks at the GLSL version
+// define, which is the only difference in their preambles
+bool sharesWebGLFrontEnd(const char* targetlang, const char* from, const char* source, const std::string& defines) {
+	if (strcmp(targetlang, "essl") != 0 || source != nullptr || from == nullptr) return false;
+	if (mentionsIdentifier(defines, "GLSL")) return false;
+	if (mentionsIdentifier(readSourceWithIncludes(from), "GLSL")) return false;
+	return pairSource.empty() || !mentionsIdentifier(readSourceWithIncludes(pairSource), "GLSL");
+}
+
 int compileOptionallyRelaxed(const char* targetlang, const char* from, std::string to, std::string ext, const char* tempdir, const char* source, char* output, int* length, const char* system,
 	glslang::TShader::Includer& includer, std::string defines, int version, bool relax) {
 	int regularErrors = 0, relaxErrors = 0, es3Errors = 0;
@@ -1184,6 +1591,30 @@ int compileOptionallyRelaxed(const char* targetlang, const char* from, std::stri
 			es3Errors = compile(targetlang, from, to + "-webgl2" + ext, tempdir, source, output, length, system, includer, defines, 300, false);
 			return es3Errors;
 		}
+		else if (output == nullptr && sharesWebGLFrontEnd(targetlang, from, source, defines)) {
+			std::string regular = to + ext;
+			glslFlavours.push_back({ regular, pairOutputFor(regular, source), 0, false, false });
+			std::string webgl2 = to + "-webgl2" + ext;
+			glslFlavours.push_back({ webgl2, pairOutputFor(webgl2, source), 300, false, false });
+			if (relax) {
+				std::string relaxed = to + "-relaxed" + ext;
+				glslFlavours.push_back({ relaxed, pairOutputFor(relaxed, source), 0, true, false });
+			}
+			// Front end errors fail every flavour, otherwise one successful flavour is enough like with separate compiles
+			bool succeeded = false;
+			if (compile(targetlang, from, regular, tempdir, source, output, length, system, includer, defines, version, false) == 0) {
+				for (auto& flavour : glslFlavours) {
+					if (flavour.failed) continue;
+					succeeded = true;
+					finishedOutput(flavour.filename);
+					if (!flavour.pairFilename.empty()) {
+						finishedOutput(flavour.pairFilename);
+					}
+				}
+			}
+			glslFlavours.clear();
+			return succeeded ? 0 : 1;
+		}
 		else {
 			regularErrors = compile(targetlang, from, to + ext, tempdir, source, output, length, system, includer, defines, version, false);
 			es3Errors = compile(targetlang, from, to + "-webgl2" + ext, tempdir, source, output, length, system, includer, defines, 300, false);
@@ -1224,7 +1655,7 @@ int compileOptionallyInstanced(const char* targetlang, const char* from, std::st
 int compileWithTextureUnits(const char* targetlang, const char* from, std::string to, std::string ext, const char* tempdir, const char* source, char* output, int* length, const char* system,
 	glslang::TShader::Includer& includer, std::string defines, int version, const std::vector<int>& textureUnitCounts, bool usesTextureUnitsCount, bool instanced, bool relax) {
 	int errors = 0;
-	if (usesTextureUnitsCount && textureUnitCounts.size() > 0) {
+	if (usesTextureUnitsCount && textureUnitCounts.size() > 0 && !specializeTextureUnits) {
 		for (size_t i = 0; i < textureUnitCounts.size(); ++i) {
 			int texcount = textureUnitCounts[i];
 			std::stringstream toto;
@@ -1296,9 +1727,65 @@ extern "C" int krafix_compile(const char* source, char* output, int* length, con
 	return compileWithTextureUnits(targetlang, from, "", shadertype, nullptr, source, output, length, system, includer, defines, version, textureUnitCounts, usesTextureUnitsCount, instancedoptional && usesInstancedoptional, relax);
 }
 
+static void splitOutputName(const std::string& to, std::string& towithoutext, std::string& ext) {
+	size_t split1 = to.find_last_of('/');
+	size_t split2 = to.find_last_of('\\');
+	size_t split;
+	if (split1 == std::string::npos && split2 == std::string::npos) {
+		split = 0;
+	}
+	else if (split1 == std::string::npos || split2 == std::string::npos) {
+		split = std::min(split1, split2);
+	}
+	else {
+		split = std::max(split1, split2);
+	}
+	towithoutext = to.substr(0, to.find_first_of('.', split));
+	ext = to.substr(to.find_first_of('.', split));
+}
+
+// Least squares slope of the resident memory samples in bytes per iteration
+static double memoryGrowth(const std::vector<size_t>& samples) {
+	double count = (double)samples.size();
+	double meanIteration = (count - 1) / 2;
+	double meanMemory = 0;
+	for (size_t sample : samples) meanMemory += (double)sample / count;
+	double covariance = 0, variance = 0;
+	for (size_t i = 0; i < samples.size(); ++i) {
+		covariance += (i - meanIteration) * ((double)samples[i] - meanMemory);
+		variance += (i - meanIteration) * (i - meanIteration);
+	}
+	return variance > 0 ? covariance / variance : 0;
+}
+
 // d3d11 in/basic.vert.glsl test.d3d11 temp windows
 #ifndef KRAFIX_LIBRARY
 int C_DECL main(int argc, char* argv[]) {
+	if (argc >= 4 && std::string(argv[1]) == "--compare-costs") {
+		double threshold = 10;
+		for (int i = 4; i < argc - 1; ++i) {
+			if (std::string(argv[i]) == "--threshold") {
+				threshold = atof(argv[i + 1]);
+			}
+		}
+		return krafix::compareCosts(argv[2], argv[3], threshold) > 0 ? 1 : 0;
+	}
+
+	// --metal-bundle out.metal in1.metal in2.metal... [--parts n]
+	if (argc >= 3 && std::string(argv[1]) == "--metal-bundle") {
+		std::vector<std::string> inputs;
+		int parts = 1;
+		for (int i = 3; i < argc; ++i) {
+			if (std::string(argv[i]) == "--parts" && i + 1 < argc) {
+				parts = atoi(argv[++i]);
+			}
+			else {
+				inputs.push_back(argv[i]);
+			}
+		}
+		return krafix::bundleMetalFiles(argv[2], inputs, parts) > 0 ? 1 : 0;
+	}
+
 	if (argc < 6) {
 		usage();
 		return 1;
@@ -1316,6 +1803,20 @@ int C_DECL main(int argc, char* argv[]) {
 	bool getDependencyFileLocation = false;
 	std::string dependencyFileLocation;
 	bool relax = false;
+	std::vector<std::string> defineArgs;
+	std::vector<std::string> specializations;
+	bool getSpecialization = false;
+	bool getPairSource = false;
+	bool getPairOutput = false;
+	bool getCostReport = false;
+	bool getSoakIterations = false;
+	bool getD3DBytecodeCommand = false;
+	bool getPostCommand = false;
+	bool getPostJobs = false;
+	bool getFrequencyName = false;
+	bool getFrequency = false;
+	std::string frequencyName;
+	std::string pairOutputName;
 
 	for (int i = 6; i < argc; ++i) {
 		std::string arg = argv[i];
@@ -1324,13 +1825,64 @@ int C_DECL main(int argc, char* argv[]) {
 			getversion = false;
 			allOptions.push_back(std::string("version: ") + argv[i]);
 		}
+		else if (getPairSource) {
+			pairSource = arg;
+			getPairSource = false;
+			getPairOutput = true;
+		}
+		else if (getPairOutput) {
+			pairOutputName = arg;
+			getPairOutput = false;
+			allOptions.push_back("pair: " + pairSource + " " + pairOutputName);
+		}
+		else if (getFrequencyName) {
+			frequencyName = arg;
+			getFrequencyName = false;
+			getFrequency = true;
+		}
+		else if (getFrequency) {
+			krafix::UpdateFrequency frequency;
+			if (!krafix::parseUpdateFrequency(arg, frequency)) {
+				std::cerr << "Unknown update frequency " << arg << ", use frame, material or draw" << std::endl;
+				return 1;
+			}
+			descriptorFrequencies[frequencyName] = frequency;
+			getFrequency = false;
+			allOptions.push_back("descriptor-frequency: " + frequencyName + " " + arg);
+		}
+		else if (getSoakIterations) {
+			soakIterations = atoi(argv[i]);
+			getSoakIterations = false;
+		}
+		else if (getD3DBytecodeCommand) {
+			d3dBytecodeCommand = arg;
+			getD3DBytecodeCommand = false;
+		}
+		else if (getPostCommand) {
+			postCommands.push_back(arg);
+			getPostCommand = false;
+			allOptions.push_back("post-command: " + arg);
+		}
+		else if (getPostJobs) {
+			postJobs = atoi(argv[i]);
+			getPostJobs = false;
+		}
+		else if (getCostReport) {
+			costReport = arg;
+			getCostReport = false;
+		}
+		else if (getSpecialization) {
+			specializations.push_back(arg);
+			getSpecialization = false;
+			allOptions.push_back(std::string("specialize: ") + arg);
+		}
 		else if (getDependencyFileLocation) {
 			dependencyFileLocation = argv[i];
 			getDependencyFileLocation = false;
 			deps = true;
 		}
 		else if (arg.substr(0, 2) == "-D") {
-			defines += "#define " + arg.substr(2) + "\n";
+			defineArgs.push_back(arg.substr(2));
 			allOptions.push_back(std::string("define: ") + arg.substr(2));
 		}
 		else if (arg.substr(0, 2) == "-T") {
@@ -1361,6 +1913,92 @@ int C_DECL main(int argc, char* argv[]) {
 		else if (arg == "--outputintermediatespirv") {
 			outputSpirv = true;
 		}
+		else if (arg == "--spirv-opt-report") {
+			spirvOptReport = true;
+		}
+		else if (arg == "--spirv-compact") {
+			spirvCompact = true;
+			allOptions.push_back("spirv-compact");
+		}
+		else if (arg == "--specialize") {
+			getSpecialization = true;
+		}
+		else if (arg == "--strip-debug") {
+			spirvStripDebug = true;
+			allOptions.push_back("strip-debug");
+		}
+		else if (arg == "--deterministic") {
+			deterministic = true;
+			allOptions.push_back("deterministic");
+		}
+		else if (arg == "--pack-uniforms") {
+			packUniforms = true;
+			allOptions.push_back("pack-uniforms");
+		}
+		else if (arg == "--uniform-blocks") {
+			uniformBlocks = true;
+			allOptions.push_back("uniform-blocks");
+		}
+		else if (arg == "--minify") {
+			minify = true;
+			allOptions.push_back("minify");
+		}
+		else if (arg == "--auto-precision") {
+			autoPrecision = true;
+			allOptions.push_back("auto-precision");
+		}
+		else if (arg == "--uniform-layout") {
+			uniformLayout = true;
+		}
+		else if (arg == "--uniform-layout-json") {
+			uniformLayoutJson = true;
+		}
+		else if (arg == "--binary-reflection") {
+			binaryReflection = true;
+		}
+		else if (arg == "--pair") {
+			getPairSource = true;
+		}
+		else if (arg == "--pack-varyings") {
+			packVaryings = true;
+			allOptions.push_back("pack-varyings");
+		}
+		else if (arg == "--report-unused") {
+			reportUnused = true;
+		}
+		else if (arg == "--strip-unused") {
+			stripUnused = true;
+			allOptions.push_back("strip-unused");
+		}
+		else if (arg == "--descriptor-sets") {
+			descriptorSets = true;
+			allOptions.push_back("descriptor-sets");
+		}
+		else if (arg == "--argument-buffers") {
+			argumentBuffers = true;
+			allOptions.push_back("argument-buffers");
+		}
+		else if (arg == "--descriptor-frequency") {
+			getFrequencyName = true;
+		}
+		else if (arg == "--soak") {
+			getSoakIterations = true;
+		}
+		else if (arg == "--d3d-bytecode-command") {
+			getD3DBytecodeCommand = true;
+		}
+		else if (arg == "--post-command") {
+			getPostCommand = true;
+		}
+		else if (arg == "--post-jobs") {
+			getPostJobs = true;
+		}
+		else if (arg == "--cost") {
+			shaderCost = true;
+		}
+		else if (arg == "--cost-report") {
+			getCostReport = true;
+		}
 	}
 
 	const char* targetlang = argv[1];
@@ -1378,6 +2016,16 @@ int C_DECL main(int argc, char* argv[]) {
 		dependencies.push_back(argv[0]);
 	}
 
+	if (!pairSource.empty()) {
+		if (pairOutputName.empty() || FindLanguage(from) == FindLanguage(pairSource)) {
+			std::cerr << "--pair needs a source of a different shader stage and an output file" << std::endl;
+			return 1;
+		}
+		if (deps) {
+			dependencies.push_back(pairSource);
+		}
+	}
+
 	bool usesTextureUnitsCount = false;
 	bool usesInstancedoptional = false;
 
@@ -1391,6 +2039,12 @@ int C_DECL main(int argc, char* argv[]) {
 			}
 			file.close();
 		}
+		if (!pairSource.empty()) {
+			std::ifstream pairFile(pairSource);
+			while (getline(pairFile, line)) {
+				filecontentstream << line << '\n';
+			}
+		}
 		std::string filecontent = filecontentstream.str();
 
 		if (filecontent.find("MAX_TEXTURE_UNITS") != std::string::npos) {
@@ -1401,30 +2055,122 @@ int C_DECL main(int argc, char* argv[]) {
 		}
 	}
 
-	size_t split1 = to.find_last_of('/');
-	size_t split2 = to.find_last_of('\\');
-	size_t split;
-	if (split1 == std::string::npos && split2 == std::string::npos) {
-		split = 0;
-	}
-	else if (split1 == std::string::npos || split2 == std::string::npos) {
-		split = std::min(split1, split2);
+	// Variant axes which are lowered to specialization constants instead of being compiled separately
+	if (specializations.size() > 0 && strcmp(targetlang, "spirv") == 0) {
+		std::string source = readSourceWithIncludes(from);
+		if (!pairSource.empty()) {
+			source += readSourceWithIncludes(pairSource);
+		}
+		std::stringstream declarations;
+		std::set<std::string> specialized;
+		unsigned specId = 0;
+		for (auto name : specializations) {
+			if (usedInPreprocessor(source, name)) {
+				std::cerr << "Warning: " << name << " is used by the preprocessor and can not be specialized in " << from << std::endl;
+				continue;
+			}
+			std::string value;
+			bool defined = false;
+			for (auto define : defineArgs) {
+				if (define.substr(0, define.find('=')) == name) {
+					value = define.find('=') == std::string::npos ? "" : define.substr(define.find('=') + 1);
+					defined = true;
+				}
+			}
+			if (name == "MAX_TEXTURE_UNITS") {
+				if (!usesTextureUnitsCount) {
+					std::cerr << "Warning: " << name << " is not used and can not be specialized in " << from << std::endl;
+					continue;
+				}
+				if (textureUnitCounts.size() == 0) {
+					std::cerr << "Warning: " << name << " has no texture unit counts given and can not be specialized in " << from << std::endl;
+					continue;
+				}
+				declarations << "layout(constant_id = " << specId << ") const int " << name << " = " << *std::max_element(textureUnitCounts.begin(), textureUnitCounts.end()) << ";\n";
+				specializeTextureUnits = true;
+			}
+			else if (value.empty()) {
+				declarations << "layout(constant_id = " << specId << ") const bool " << name << " = " << (defined ? "true" : "false") << ";\n";
+			}
+			else if (value.find('.') != std::string::npos) {
+				declarations << "layout(constant_id = " << specId << ") const float " << name << " = " << value << ";\n";
+			}
+			else {
+				declarations << "layout(constant_id = " << specId << ") const int " << name << " = " << value << ";\n";
+			}
+			if (!quiet) {
+				std::cerr << "#specialization:" << name << ":" << specId << std::endl;
+			}
+			specialized.insert(name);
+			++specId;
+		}
+		specializationConstants = declarations.str();
+		// Kore tests INSTANCED_RENDERING with #ifdef, only shaders reading it as a bool get the constant instead of the -inst variant
+		if (specialized.count("INSTANCED_RENDERING") != 0) usesInstancedoptional = false;
+		for (auto name : specialized) {
+			defineArgs.erase(std::remove_if(defineArgs.begin(), defineArgs.end(), [&name](const std::string& define) { return define.substr(0, define.find('=')) == name; }), defineArgs.end());
+		}
 	}
-	else {
-		split = std::max(split1, split2);
+
+	for (auto define : defineArgs) {
+		defines += "#define " + define + "\n";
 	}
-	std::string towithoutext = to.substr(0, to.find_first_of('.', split));
-	std::string ext = to.substr(to.find_first_of('.', split));
 
-	int errors = 0;
-	if (strcmp(targetlang, "varlist") == 0) {
-		int length = 0;
-		compile(targetlang, from, to, tempdir, nullptr, nullptr, &length, system, includer, defines, version, false);
-		if (CompileFailed || LinkFailed) ++errors;
+	std::string towithoutext, ext;
+	splitOutputName(to, towithoutext, ext);
+
+	if (!pairOutputName.empty()) {
+		std::string pairExt;
+		primaryOutputBase = towithoutext;
+		splitOutputName(pairOutputName, pairOutputBase, pairExt);
 	}
-	else {
-		int length = 0;
-		errors = compileWithTextureUnits(targetlang, from, towithoutext, ext, tempdir, nullptr, nullptr, &length, system, includer, defines, version, textureUnitCounts, usesTextureUnitsCount, instancedoptional && usesInstancedoptional, relax);
+
+	auto compileAll = [&]() {
+		int errors = 0;
+		if (strcmp(targetlang, "varlist") == 0) {
+			int length = 0;
+			compile(targetlang, from, to, tempdir, nullptr, nullptr, &length, system, includer, defines, version, false);
+			if (CompileFailed || LinkFailed) ++errors;
+		}
+		else {
+			int length = 0;
+			errors = compileWithTextureUnits(targetlang, from, towithoutext, ext, tempdir, nullptr, nullptr, &length, system, includer, defines, version, textureUnitCounts, usesTextureUnitsCount, instancedoptional && usesInstancedoptional, relax);
+		}
+		if (postCommandPool != nullptr) {
+			errors += postCommandPool->finish();
+		}
+		return errors;
+	};
+
+	std::unique_ptr<krafix::PostCommandPool> pool;
+	if (!postCommands.empty()) {
+		pool.reset(new krafix::PostCommandPool(postCommands, postJobs > 0 ? postJobs : std::max(1u, std::thread::hardware_concurrency()), executeSync));
+		postCommandPool = pool.get();
+	}
+
+	int errors = compileAll();
+
+	// Repeats the compilation and fails when the resident memory still grows after a warm up. Memory is
+	// sampled after every compile and fitted to a line, a leak of more than soakLeakBytes per compile fails
+	// once it added up to more than soakLeakPages, which keeps single page steps of the allocator out.
+	if (soakIterations > 0 && errors == 0) {
+		const double soakLeakBytes = 64;
+		const double soakLeakPages = 16 * 4096;
+		quiet = true;
+		int warmup = std::max(1, soakIterations / 10);
+		std::vector<size_t> samples;
+		for (int i = 0; i < soakIterations && errors == 0; ++i) {
+			errors += compileAll();
+			if (i >= warmup) samples.push_back(residentMemory());
+		}
+		if (samples.size() > 1 && samples.front() > 0) {
+			double growth = memoryGrowth(samples);
+			std::cerr << "#soak:" << soakIterations << ":" << samples.front() << ":" << samples.back() << ":" << growth << std::endl;
+			if (growth > soakLeakBytes && growth * samples.size() > soakLeakPages) {
+				std::cerr << "Resident memory grew by " << growth << " bytes per compile from " << samples.front() << " to " << samples.back() << " bytes" << std::endl;
+				errors += 1;
+			}
+		}
 	}
 
 	if (deps && errors == 0) {
@@ -1556,6 +2302,7 @@ void CompileFile(const char* fileName, ShHandle compiler)
 void usage()
 {
 	printf("Usage: krafix profile in out tempdir system\n");
+	printf("       krafix --compare-costs olddir newdir [--threshold percent]\n");
 
 	/*printf("Usage: glslangValidator [option]... [file]...\n"
 		   "\n"
@@ -1756,20 +2503,56 @@ void InfoLogMsg(const char* msg, const char* name, const int num)
 
 #ifdef _WIN32
 #include <Windows.h>
+#define PSAPI_VERSION 2
+#include <Psapi.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#else
+#include <unistd.h>
+#endif
+#ifndef _WIN32
+#include <sys/wait.h>
 #endif
 
-void executeSync(const char* command) {
+size_t residentMemory() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return counters.WorkingSetSize;
+#elif defined(__APPLE__)
+	mach_task_basic_info_data_t info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) return 0;
+	return info.resident_size;
+#else
+	long pages = 0, residentPages = 0;
+	FILE* statm = fopen("/proc/self/statm", "r");
+	if (statm == nullptr) return 0;
+	int read = fscanf(statm, "%ld %ld", &pages, &residentPages);
+	fclose(statm);
+	return read == 2 ? (size_t)residentPages * (size_t)sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+
+int executeSync(const char* command) {
 #ifdef _WIN32
 	STARTUPINFOA startupInfo;
 	PROCESS_INFORMATION processInfo;
 	memset(&startupInfo, 0, sizeof(startupInfo));
 	memset(&processInfo, 0, sizeof(processInfo));
 	startupInfo.cb = sizeof(startupInfo);
-	CreateProcessA(nullptr, (char*)command, nullptr, nullptr, FALSE, CREATE_DEFAULT_ERROR_MODE, "PATH=%PATH%;.\\cygwin\\bin\0", nullptr, &startupInfo, &processInfo);
+	if (!CreateProcessA(nullptr, (char*)command, nullptr, nullptr, FALSE, CREATE_DEFAULT_ERROR_MODE, "PATH=%PATH%;.\\cygwin\\bin\0", nullptr, &startupInfo, &processInfo)) {
+		return -1;
+	}
 	WaitForSingleObject(processInfo.hProcess, INFINITE);
+	DWORD exitCode = 1;
+	GetExitCodeProcess(processInfo.hProcess, &exitCode);
 	CloseHandle(processInfo.hProcess);
 	CloseHandle(processInfo.hThread);
+	return (int)exitCode;
 #else
-	system(command);
+	int status = system(command);
+	if (status == -1 || !WIFEXITED(status)) return -1;
+	return WEXITSTATUS(status);
 #endif
 }